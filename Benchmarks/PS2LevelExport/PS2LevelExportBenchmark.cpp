@@ -0,0 +1,516 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Times each stage of a map export on generated scenes, in the order FPS2LevelEditingToolsModule::ExportMap runs them:
+// resolving mesh references, converting component and instance transforms, grouping foliage by mesh, then writing the
+// .lvl with matrix and compact transforms. Each stage is run until it has taken at least --min-time seconds and the
+// fastest run is reported.
+//
+// The written bytes are hashed and checked against Golden/PS2LevelExport.golden, so a change that alters the output
+// fails the run. Rerun with --update-golden when the output is meant to change, and commit the new golden file.
+
+#include "PS2LevelCore.h"
+#include "SyntheticPS2Scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#ifndef PS2_LEVEL_EXPORT_GOLDEN_FILE
+#define PS2_LEVEL_EXPORT_GOLDEN_FILE "Golden/PS2LevelExport.golden"
+#endif
+
+namespace PS2LevelExportBenchmark
+{
+	// Stand-in for Asset::Reference, which is made from the asset's path
+	struct FReference
+	{
+		uint32_t Hash[2];
+
+		bool operator==(const FReference& Other) const { return Hash[0] == Other.Hash[0] && Hash[1] == Other.Hash[1]; }
+	};
+
+	using FInstanceGroup = PS2LevelCore::TInstanceGroup<FReference>;
+	using FInstanceBatch = PS2LevelCore::TInstanceBatch<FReference>;
+
+	static uint64_t HashBytes(const void* Data, size_t Size, uint64_t Hash = 0xcbf29ce484222325ull)
+	{
+		// FNV-1a
+		const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+		for (size_t Index = 0; Index < Size; ++Index)
+		{
+			Hash = (Hash ^ Bytes[Index]) * 0x100000001b3ull;
+		}
+		return Hash;
+	}
+
+	static FReference MakeReference(const std::string& Path)
+	{
+		const uint64_t Hash = HashBytes(Path.data(), Path.size());
+		return FReference{ { uint32_t(Hash), uint32_t(Hash >> 32) } };
+	}
+
+	class FMemoryOutput : public PS2LevelCore::ILevelOutput
+	{
+	public:
+		std::vector<uint8_t> Bytes;
+
+		virtual void Write(const void* Data, size_t Size) override
+		{
+			if (Position + Size > Bytes.size())
+			{
+				Bytes.resize(Position + Size);
+			}
+			std::memcpy(Bytes.data() + Position, Data, Size);
+			Position += Size;
+		}
+		virtual int64_t Tell() const override { return int64_t(Position); }
+		virtual void Seek(int64_t NewPosition) override { Position = size_t(NewPosition); }
+		virtual bool IsError() const override { return false; }
+
+		void Reset()
+		{
+			Bytes.clear();
+			Position = 0;
+		}
+
+	private:
+		size_t Position = 0;
+	};
+
+	/** What the map export has collected by the time it writes the level. */
+	struct FCollectedLevel
+	{
+		// Resolved reference of each component, in scene order
+		std::vector<FReference> ComponentReferences;
+
+		std::vector<PS2LevelCore::FMatrix44> MeshTransforms;
+		std::vector<FReference> MeshFileReferences;
+
+		// Foliage transforms of every component back to back, in scene order
+		std::vector<PS2LevelCore::FMatrix44> FoliageTransforms;
+		std::vector<FInstanceBatch> FoliageBatches;
+
+		std::vector<FInstanceGroup> InstanceGroups;
+		std::vector<PS2LevelCore::FMatrix44> InstanceTransforms;
+	};
+
+	// Stand-in for the egg serializer's LevelFileHeader, which holds the same two arrays
+	static std::vector<uint8_t> SerializeHeader(const FCollectedLevel& Level)
+	{
+		const uint32_t NumMeshes = uint32_t(Level.MeshTransforms.size());
+		const uint32_t ReferencesOffset = 16;
+		const uint32_t TransformsOffset = (ReferencesOffset + NumMeshes * uint32_t(sizeof(FReference)) + 15) & ~15u;
+		const uint32_t Header[4] = { NumMeshes, ReferencesOffset, TransformsOffset, 0 };
+
+		std::vector<uint8_t> Bytes(TransformsOffset + NumMeshes * sizeof(PS2LevelCore::FMatrix44), 0);
+		std::memcpy(Bytes.data(), Header, sizeof(Header));
+		std::memcpy(Bytes.data() + ReferencesOffset, Level.MeshFileReferences.data(), NumMeshes * sizeof(FReference));
+		std::memcpy(Bytes.data() + TransformsOffset, Level.MeshTransforms.data(), NumMeshes * sizeof(PS2LevelCore::FMatrix44));
+		return Bytes;
+	}
+
+	static void WriteLevel(const FCollectedLevel& Level, PS2LevelCore::ETransformEncoding Encoding, FMemoryOutput& Output, PS2LevelCore::FLevelWriteReport& Report)
+	{
+		const std::vector<uint8_t> Header = SerializeHeader(Level);
+
+		PS2LevelCore::FLevelView View;
+		View.Header = Header.data();
+		View.HeaderSize = Header.size();
+		View.Instances.Groups = Level.InstanceGroups.data();
+		View.Instances.NumGroups = Level.InstanceGroups.size();
+		View.Instances.GroupSize = sizeof(FInstanceGroup);
+		View.Instances.Transforms = Level.InstanceTransforms.data();
+		View.Instances.NumTransforms = Level.InstanceTransforms.size();
+
+		// Defaults of the developer settings
+		PS2LevelCore::FLevelWriteOptions Options;
+		Options.TransformEncoding = Encoding;
+		Options.MaxPositionError = 0.5f;
+		Options.MaxBasisError = 0.002f;
+
+		Output.Reset();
+		PS2LevelCore::WriteLevel(View, Output, Options, &Report, [](float) { return true; });
+	}
+
+	struct FStageResult
+	{
+		const char* Name;
+		double Seconds;
+		size_t NumItems;
+	};
+
+	// Peak resident set of the process in bytes, 0 where it isn't known
+	static size_t GetPeakMemory()
+	{
+#if defined(__linux__)
+		rusage Usage;
+		getrusage(RUSAGE_SELF, &Usage);
+		return size_t(Usage.ru_maxrss) * 1024;
+#elif defined(__APPLE__)
+		rusage Usage;
+		getrusage(RUSAGE_SELF, &Usage);
+		return size_t(Usage.ru_maxrss);
+#else
+		return 0;
+#endif
+	}
+
+	// Runs Setup then Stage until the timed runs add up to MinTime, returns the fastest run
+	static double TimeStage(double MinTime, const std::function<void()>& Setup, const std::function<void()>& Stage)
+	{
+		using FClock = std::chrono::steady_clock;
+
+		double Best = 1.e30;
+		double Total = 0.;
+		int32_t NumRuns = 0;
+		while (Total < MinTime || NumRuns < 3)
+		{
+			Setup();
+			const FClock::time_point Start = FClock::now();
+			Stage();
+			const double Seconds = std::chrono::duration<double>(FClock::now() - Start).count();
+			Best = std::min(Best, Seconds);
+			Total += Seconds;
+			NumRuns++;
+		}
+		return Best;
+	}
+
+	static std::string MakeCaseName(const FSyntheticPS2SceneOptions& Options, PS2LevelCore::ETransformEncoding Encoding)
+	{
+		std::ostringstream Name;
+		Name << Options.NumActors << ':' << Options.NumMeshes << ':' << Options.NumInstances << ' ' << (Encoding == PS2LevelCore::ETransformEncoding::Compact ? "compact" : "matrix");
+		return Name.str();
+	}
+
+	static std::string FormatHash(uint64_t Hash)
+	{
+		char Text[17];
+		std::snprintf(Text, sizeof(Text), "%016llx", (unsigned long long)Hash);
+		return Text;
+	}
+
+	/** Expected size and hash of each case's output, keyed by case name. */
+	struct FGoldenFile
+	{
+		std::map<std::string, std::string> Entries;
+
+		bool Load(const std::string& Path)
+		{
+			std::ifstream File(Path);
+			if (!File)
+			{
+				return false;
+			}
+
+			std::string Line;
+			while (std::getline(File, Line))
+			{
+				// "<actors>:<meshes>:<instances> <encoding> <size> <hash>"
+				std::istringstream Fields(Line);
+				std::string Scene, Encoding, Size, Hash;
+				if (Line.empty() || Line[0] == '#' || !(Fields >> Scene >> Encoding >> Size >> Hash))
+				{
+					continue;
+				}
+				Entries[Scene + ' ' + Encoding] = Size + ' ' + Hash;
+			}
+			return true;
+		}
+
+		bool Save(const std::string& Path) const
+		{
+			std::ofstream File(Path);
+			File << "# Size and FNV-1a hash of the .lvl written for each benchmark scene, see PS2LevelExportBenchmark.cpp\n";
+			File << "# <actors>:<meshes>:<instances> <encoding> <size> <hash>\n";
+			for (const auto& Entry : Entries)
+			{
+				File << Entry.first << ' ' << Entry.second << '\n';
+			}
+			return bool(File);
+		}
+	};
+
+	struct FBenchmarkOptions
+	{
+		double MinTime = 0.25;
+		std::string GoldenPath = PS2_LEVEL_EXPORT_GOLDEN_FILE;
+		bool bCheckGolden = true;
+		bool bUpdateGolden = false;
+
+		// Directory to write each case's .lvl to, for diffing against a previous build
+		std::string OutputDirectory;
+	};
+
+	// Returns the number of cases whose output didn't match the golden file
+	static int32_t RunScene(const FSyntheticPS2SceneOptions& SceneOptions, const FBenchmarkOptions& Options, FGoldenFile& Golden)
+	{
+		const FSyntheticPS2Scene Scene = GenerateSyntheticPS2Scene(SceneOptions);
+
+		size_t NumComponents = 0;
+		size_t NumInstances = 0;
+		for (const FSyntheticPS2Scene::FActor& Actor : Scene.Actors)
+		{
+			for (const FSyntheticPS2Scene::FComponent& Component : Actor.Components)
+			{
+				NumComponents++;
+				NumInstances += Component.bInstanced ? Component.Instances.size() : 0;
+			}
+		}
+
+		FCollectedLevel Level;
+		std::vector<FStageResult> Results;
+		auto NoSetup = []() {};
+
+		// FPS2AssetReferenceCache works out each mesh's reference once and looks it up for every other component
+		Results.push_back({ "resolve references", TimeStage(Options.MinTime, NoSetup, [&]()
+			{
+				std::unordered_map<uint32_t, FReference> ResolvedMeshes;
+				Level.ComponentReferences.clear();
+				Level.ComponentReferences.reserve(NumComponents);
+				for (const FSyntheticPS2Scene::FActor& Actor : Scene.Actors)
+				{
+					for (const FSyntheticPS2Scene::FComponent& Component : Actor.Components)
+					{
+						auto Resolved = ResolvedMeshes.find(Component.Mesh);
+						if (Resolved == ResolvedMeshes.end())
+						{
+							Resolved = ResolvedMeshes.emplace(Component.Mesh, MakeReference(Scene.MeshPaths[Component.Mesh])).first;
+						}
+						Level.ComponentReferences.push_back(Resolved->second);
+					}
+				}
+			}), NumComponents });
+
+		Results.push_back({ "convert transforms", TimeStage(Options.MinTime, [&]()
+			{
+				Level.MeshTransforms.clear();
+				Level.MeshFileReferences.clear();
+				Level.FoliageTransforms.clear();
+				Level.FoliageBatches.clear();
+			},
+			[&]()
+			{
+				Level.FoliageTransforms.resize(NumInstances);
+				size_t ComponentIndex = 0;
+				size_t FoliageOutput = 0;
+				for (const FSyntheticPS2Scene::FActor& Actor : Scene.Actors)
+				{
+					for (const FSyntheticPS2Scene::FComponent& Component : Actor.Components)
+					{
+						const FReference& Reference = Level.ComponentReferences[ComponentIndex++];
+						if (Component.bInstanced)
+						{
+							PS2LevelCore::FMatrix44* Output = Level.FoliageTransforms.data() + FoliageOutput;
+							PS2LevelCore::ConvertInstanceTransforms(reinterpret_cast<const uint8_t*>(Component.Instances.data()), sizeof(PS2LevelCore::FMatrix44), Component.Instances.size(), Component.Transform, Output);
+							Level.FoliageBatches.push_back({ Reference, Output, Component.Instances.size() });
+							FoliageOutput += Component.Instances.size();
+						}
+						else
+						{
+							Level.MeshTransforms.push_back(PS2LevelCore::ConvertTransform(Component.Transform));
+							Level.MeshFileReferences.push_back(Reference);
+						}
+					}
+				}
+			}), NumComponents + NumInstances });
+
+		Results.push_back({ "group instances", TimeStage(Options.MinTime, [&]()
+			{
+				Level.InstanceGroups.clear();
+				Level.InstanceTransforms.clear();
+			},
+			[&]()
+			{
+				std::vector<uint32_t> BatchGroups;
+				const size_t NumGrouped = PS2LevelCore::GroupInstances(Level.FoliageBatches.data(), Level.FoliageBatches.size(), Level.InstanceGroups, BatchGroups);
+				Level.InstanceTransforms.resize(NumGrouped);
+				PS2LevelCore::CopyGroupedInstances(Level.FoliageBatches.data(), Level.FoliageBatches.size(), BatchGroups.data(), Level.InstanceGroups, Level.InstanceTransforms.data());
+			}), NumInstances });
+
+		std::printf("%s: %zu components, %zu instances, %zu instance groups\n", DescribeSyntheticPS2Scene(SceneOptions).c_str(), NumComponents, NumInstances, Level.InstanceGroups.size());
+
+		int32_t NumMismatches = 0;
+		const PS2LevelCore::ETransformEncoding Encodings[] = { PS2LevelCore::ETransformEncoding::Matrix, PS2LevelCore::ETransformEncoding::Compact };
+		for (PS2LevelCore::ETransformEncoding Encoding : Encodings)
+		{
+			FMemoryOutput Output;
+			PS2LevelCore::FLevelWriteReport Report;
+			const bool bCompact = Encoding == PS2LevelCore::ETransformEncoding::Compact;
+			Results.push_back({ bCompact ? "write compact" : "write matrices", TimeStage(Options.MinTime, NoSetup, [&]()
+				{
+					WriteLevel(Level, Encoding, Output, Report);
+				}), NumComponents + NumInstances });
+
+			const std::string CaseName = MakeCaseName(SceneOptions, Encoding);
+			const std::string Result = std::to_string(Output.Bytes.size()) + ' ' + FormatHash(HashBytes(Output.Bytes.data(), Output.Bytes.size()));
+
+			const char* Status = "";
+			if (Options.bUpdateGolden)
+			{
+				Golden.Entries[CaseName] = Result;
+				Status = "golden updated";
+			}
+			else if (Options.bCheckGolden)
+			{
+				auto Expected = Golden.Entries.find(CaseName);
+				if (Expected == Golden.Entries.end())
+				{
+					Status = "no golden";
+				}
+				else if (Expected->second == Result)
+				{
+					Status = "matches golden";
+				}
+				else
+				{
+					Status = "DIFFERS FROM GOLDEN";
+					NumMismatches++;
+				}
+			}
+
+			std::printf("  %-8s %12zu bytes  hash %s  %s", bCompact ? "compact" : "matrix", Output.Bytes.size(), Result.substr(Result.find(' ') + 1).c_str(), Status);
+			if (bCompact)
+			{
+				std::printf("  (%d compact sections, %d rejected, max position error %g, max basis error %g)", Report.NumCompactSections, Report.NumRejectedSections,
+					double(std::max(Report.MaxPositionError, Report.MaxRejectedPositionError)), double(std::max(Report.MaxBasisError, Report.MaxRejectedBasisError)));
+			}
+			std::printf("\n");
+
+			if (!Options.OutputDirectory.empty())
+			{
+				std::string FileName = CaseName;
+				std::replace(FileName.begin(), FileName.end(), ':', '_');
+				std::replace(FileName.begin(), FileName.end(), ' ', '_');
+				std::ofstream File(Options.OutputDirectory + '/' + FileName + ".lvl", std::ios::binary);
+				File.write(reinterpret_cast<const char*>(Output.Bytes.data()), std::streamsize(Output.Bytes.size()));
+			}
+		}
+
+		double TotalSeconds = 0.;
+		for (const FStageResult& Result : Results)
+		{
+			TotalSeconds += Result.Seconds;
+			std::printf("  %-20s %10.3f ms %12.2f Mitems/s\n", Result.Name, Result.Seconds * 1.e3, Result.NumItems / Result.Seconds * 1.e-6);
+		}
+		std::printf("  %-20s %10.3f ms %12.2f Minstances/s\n", "total", TotalSeconds * 1.e3, (NumComponents + NumInstances) / TotalSeconds * 1.e-6);
+		std::printf("  peak memory %.1f MiB\n\n", GetPeakMemory() / (1024. * 1024.));
+
+		return NumMismatches;
+	}
+
+	static bool ParseScenes(const char* Argument, std::vector<FSyntheticPS2SceneOptions>& OutScenes)
+	{
+		OutScenes.clear();
+		std::istringstream List(Argument);
+		std::string Scene;
+		while (std::getline(List, Scene, ','))
+		{
+			FSyntheticPS2SceneOptions Options;
+			unsigned long long Actors = 0, Meshes = 0, Instances = 0;
+			if (std::sscanf(Scene.c_str(), "%llu:%llu:%llu", &Actors, &Meshes, &Instances) != 3)
+			{
+				return false;
+			}
+			Options.NumActors = size_t(Actors);
+			Options.NumMeshes = size_t(Meshes);
+			Options.NumInstances = size_t(Instances);
+			OutScenes.push_back(Options);
+		}
+		return !OutScenes.empty();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace PS2LevelExportBenchmark;
+
+	// Up to 1M foliage instances
+	std::vector<FSyntheticPS2SceneOptions> Scenes(3);
+	Scenes[0].NumActors = 100;
+	Scenes[0].NumMeshes = 10;
+	Scenes[0].NumInstances = 10;
+	Scenes[1].NumActors = 1000;
+	Scenes[1].NumMeshes = 50;
+	Scenes[1].NumInstances = 100;
+	Scenes[2].NumActors = 1000;
+	Scenes[2].NumMeshes = 100;
+	Scenes[2].NumInstances = 1000;
+
+	FBenchmarkOptions Options;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--scenes") == 0 && i + 1 < argc && ParseScenes(argv[i + 1], Scenes))
+		{
+			++i;
+		}
+		else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+		{
+			Options.MinTime = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+		{
+			Options.GoldenPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--no-golden") == 0)
+		{
+			Options.bCheckGolden = false;
+		}
+		else if (std::strcmp(argv[i], "--update-golden") == 0)
+		{
+			Options.bUpdateGolden = true;
+		}
+		else if (std::strcmp(argv[i], "--write-lvl") == 0 && i + 1 < argc)
+		{
+			Options.OutputDirectory = argv[++i];
+		}
+		else
+		{
+			std::fprintf(stderr, "Usage: %s [--scenes actors:meshes:instances,...] [--min-time 0.25] [--golden file] [--no-golden] [--update-golden] [--write-lvl dir]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	FGoldenFile Golden;
+	if ((Options.bCheckGolden || Options.bUpdateGolden) && !Golden.Load(Options.GoldenPath) && !Options.bUpdateGolden)
+	{
+		std::fprintf(stderr, "Couldn't read golden file %s, run with --update-golden to create it or --no-golden to skip the check\n", Options.GoldenPath.c_str());
+		return 1;
+	}
+
+	int32_t NumMismatches = 0;
+	for (const FSyntheticPS2SceneOptions& Scene : Scenes)
+	{
+		NumMismatches += RunScene(Scene, Options, Golden);
+	}
+
+	if (Options.bUpdateGolden)
+	{
+		if (!Golden.Save(Options.GoldenPath))
+		{
+			std::fprintf(stderr, "Couldn't write golden file %s\n", Options.GoldenPath.c_str());
+			return 1;
+		}
+		std::printf("Updated %s\n", Options.GoldenPath.c_str());
+	}
+
+	if (NumMismatches > 0)
+	{
+		std::fprintf(stderr, "%d outputs differ from %s\n", NumMismatches, Options.GoldenPath.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SyntheticPS2Scene.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace SyntheticPS2Scene
+{
+	// xorshift32, the standard library's distributions aren't the same everywhere
+	struct FRandom
+	{
+		uint32_t State;
+
+		explicit FRandom(uint32_t Seed) : State(Seed ? Seed : 1) {}
+
+		uint32_t Next()
+		{
+			State ^= State << 13;
+			State ^= State >> 17;
+			State ^= State << 5;
+			return State;
+		}
+
+		// In [Min, Max), in steps of 1/65536 of the range
+		double Range(double Min, double Max)
+		{
+			return Min + (Max - Min) * double(Next() >> 16) / 65536.;
+		}
+	};
+
+	static void MakeRotation(FRandom& Random, double OutRotation[4])
+	{
+		// Any direction normalizes to a valid quaternion, retry the rare ones too short to normalize well
+		double SizeSquared = 0.;
+		do
+		{
+			for (int32_t Index = 0; Index < 4; ++Index)
+			{
+				OutRotation[Index] = Random.Range(-1., 1.);
+			}
+			SizeSquared = OutRotation[0] * OutRotation[0] + OutRotation[1] * OutRotation[1] + OutRotation[2] * OutRotation[2] + OutRotation[3] * OutRotation[3];
+		}
+		while (SizeSquared < 0.01);
+
+		const double InvSize = 1. / std::sqrt(SizeSquared);
+		for (int32_t Index = 0; Index < 4; ++Index)
+		{
+			OutRotation[Index] *= InvSize;
+		}
+	}
+
+	// Foliage sits upright and spins about UE's Z, with some uniform scale
+	static PS2LevelCore::FMatrix44 MakeInstance(FRandom& Random)
+	{
+		double Yaw[2] = { Random.Range(-1., 1.), Random.Range(-1., 1.) };
+		const double Size = std::sqrt(Yaw[0] * Yaw[0] + Yaw[1] * Yaw[1]);
+		if (Size < 1.e-3)
+		{
+			Yaw[0] = 1.;
+			Yaw[1] = 0.;
+		}
+		else
+		{
+			Yaw[0] /= Size;
+			Yaw[1] /= Size;
+		}
+
+		const double Scale = Random.Range(0.75, 1.5);
+		PS2LevelCore::FMatrix44 Instance = {};
+		Instance.M[0][0] = float(Yaw[0] * Scale);
+		Instance.M[0][1] = float(Yaw[1] * Scale);
+		Instance.M[1][0] = float(-Yaw[1] * Scale);
+		Instance.M[1][1] = float(Yaw[0] * Scale);
+		Instance.M[2][2] = float(Scale);
+		Instance.M[3][0] = float(Random.Range(-5000., 5000.));
+		Instance.M[3][1] = float(Random.Range(-5000., 5000.));
+		Instance.M[3][2] = float(Random.Range(-50., 50.));
+		Instance.M[3][3] = 1.f;
+		return Instance;
+	}
+}
+
+FSyntheticPS2Scene GenerateSyntheticPS2Scene(const FSyntheticPS2SceneOptions& Options)
+{
+	using namespace SyntheticPS2Scene;
+
+	FSyntheticPS2Scene Scene;
+	FRandom Random(Options.Seed);
+
+	for (size_t MeshIndex = 0; MeshIndex < Options.NumMeshes; ++MeshIndex)
+	{
+		char Path[64];
+		std::snprintf(Path, sizeof(Path), "meshes/synthetic_%zu.mdl", MeshIndex);
+		Scene.MeshPaths.push_back(Path);
+	}
+
+	const uint32_t NumMeshes = uint32_t(Options.NumMeshes > 0 ? Options.NumMeshes : 1);
+	Scene.Actors.resize(Options.NumActors);
+	for (FSyntheticPS2Scene::FActor& Actor : Scene.Actors)
+	{
+		// Actors are spread over a 200m square, in UE units, small enough for compact transforms to be within the default limits
+		PS2LevelCore::FTransform ActorTransform;
+		MakeRotation(Random, ActorTransform.Rotation);
+		ActorTransform.Translation[0] = Random.Range(-10000., 10000.);
+		ActorTransform.Translation[1] = Random.Range(-10000., 10000.);
+		ActorTransform.Translation[2] = Random.Range(-1000., 1000.);
+		const double Scale = Random.Range(0.5, 2.);
+		ActorTransform.Scale[0] = ActorTransform.Scale[1] = ActorTransform.Scale[2] = Scale;
+
+		FSyntheticPS2Scene::FComponent& StaticMesh = Actor.Components.emplace_back();
+		StaticMesh.Mesh = Random.Next() % NumMeshes;
+		StaticMesh.Transform = ActorTransform;
+		StaticMesh.bInstanced = false;
+
+		// Foliage components are upright and unscaled, their instances carry the variation
+		FSyntheticPS2Scene::FComponent& Foliage = Actor.Components.emplace_back();
+		Foliage.Mesh = Random.Next() % NumMeshes;
+		Foliage.Transform = PS2LevelCore::FTransform{ { 0., 0., 0., 1. }, { ActorTransform.Translation[0], ActorTransform.Translation[1], 0. }, { 1., 1., 1. } };
+		Foliage.bInstanced = true;
+		Foliage.Instances.reserve(Options.NumInstances);
+		for (size_t InstanceIndex = 0; InstanceIndex < Options.NumInstances; ++InstanceIndex)
+		{
+			Foliage.Instances.push_back(MakeInstance(Random));
+		}
+	}
+
+	return Scene;
+}
+
+std::string DescribeSyntheticPS2Scene(const FSyntheticPS2SceneOptions& Options)
+{
+	char Description[128];
+	std::snprintf(Description, sizeof(Description), "%zu actors, %zu meshes, %zu instances each", Options.NumActors, Options.NumMeshes, Options.NumInstances);
+	return Description;
+}
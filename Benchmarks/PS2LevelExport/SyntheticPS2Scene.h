@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "PS2LevelCore.h"
+
+/**
+ * Generated stand-in for the actors of a map. Each actor has one static mesh component and one foliage component, which
+ * is what the map export collects, so the benchmark doesn't need the editor.
+ *
+ * Everything is generated from the seed with integer arithmetic and square roots, so a scene is the same on every
+ * platform and standard library and its exported bytes can be compared against golden files.
+ */
+struct FSyntheticPS2Scene
+{
+	struct FComponent
+	{
+		uint32_t Mesh;
+		PS2LevelCore::FTransform Transform;
+
+		// Instance transforms relative to the component, only for foliage
+		std::vector<PS2LevelCore::FMatrix44> Instances;
+		bool bInstanced;
+	};
+
+	struct FActor
+	{
+		std::vector<FComponent> Components;
+	};
+
+	// Asset paths of the distinct meshes, components index into these
+	std::vector<std::string> MeshPaths;
+	std::vector<FActor> Actors;
+};
+
+struct FSyntheticPS2SceneOptions
+{
+	size_t NumActors = 1000;
+	size_t NumMeshes = 100;
+
+	// Foliage instances per actor
+	size_t NumInstances = 100;
+
+	uint32_t Seed = 1;
+};
+
+FSyntheticPS2Scene GenerateSyntheticPS2Scene(const FSyntheticPS2SceneOptions& Options);
+
+std::string DescribeSyntheticPS2Scene(const FSyntheticPS2SceneOptions& Options);
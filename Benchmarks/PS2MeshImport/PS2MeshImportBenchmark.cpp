@@ -0,0 +1,333 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Times each stage of a .mdl import on generated meshes, in the order UInterchangePS2ModelTranslator runs them:
+// interleaving the file's arrays, strip decoding, welding, then basis conversion and color linearization of the welded
+// vertices, and the optional LOD simplification on its own. Each stage is run until it has taken at least --min-time
+// seconds and the fastest run is reported.
+//
+// The welded triangles are also turned back into strips the way UPS2ModelExporter writes them and decoded again, as
+// one stream and one VU1 batch at a time. Any triangle lost, added or rewound on the way fails the run.
+
+#include "PS2MeshCore.h"
+#include "SyntheticPS2Mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace PS2MeshImportBenchmark
+{
+	// Same layout as FPS2Vertex in the translator
+	struct FVertex
+	{
+		FSyntheticPS2Mesh::FVector4 pos;
+		FSyntheticPS2Mesh::FVector4 nrm;
+		FSyntheticPS2Mesh::FVector2 uvs;
+		FSyntheticPS2Mesh::FVector4 colors;
+	};
+
+	struct FStageResult
+	{
+		const char* Name;
+		double Seconds;
+		size_t NumVertices;
+		size_t NumTriangles;
+	};
+
+	// Peak resident set of the process in bytes, 0 where it isn't known
+	static size_t GetPeakMemory()
+	{
+#if defined(__linux__)
+		rusage Usage;
+		getrusage(RUSAGE_SELF, &Usage);
+		return size_t(Usage.ru_maxrss) * 1024;
+#elif defined(__APPLE__)
+		rusage Usage;
+		getrusage(RUSAGE_SELF, &Usage);
+		return size_t(Usage.ru_maxrss);
+#else
+		return 0;
+#endif
+	}
+
+	// Runs Setup then Stage until the timed runs add up to MinTime, returns the fastest run
+	static double TimeStage(double MinTime, const std::function<void()>& Setup, const std::function<void()>& Stage)
+	{
+		using FClock = std::chrono::steady_clock;
+
+		double Best = 1.e30;
+		double Total = 0.;
+		int32_t NumRuns = 0;
+		while (Total < MinTime || NumRuns < 3)
+		{
+			Setup();
+			const FClock::time_point Start = FClock::now();
+			Stage();
+			const double Seconds = std::chrono::duration<double>(FClock::now() - Start).count();
+			Best = std::min(Best, Seconds);
+			Total += Seconds;
+			NumRuns++;
+		}
+		return Best;
+	}
+
+	// A triangle rotated to start at its smallest index, which keeps its winding
+	static std::array<uint32_t, 3> CanonicalTriangle(uint32_t A, uint32_t B, uint32_t C)
+	{
+		if (B < A && B < C)
+		{
+			return { B, C, A };
+		}
+		if (C < A && C < B)
+		{
+			return { C, A, B };
+		}
+		return { A, B, C };
+	}
+
+	// Decodes Num entries of a strip stream starting at First, appending its triangles as indices into the welded vertices
+	static void DecodeStripEntries(const std::vector<PS2MeshCore::FStripEntry>& Entries, const std::vector<FVertex>& Vertices, size_t First, size_t Num, PS2MeshCore::EStripRestartMode RestartMode,
+		std::vector<std::array<uint32_t, 3>>& OutTriangles)
+	{
+		std::vector<FSyntheticPS2Mesh::FVector4> Positions(Num);
+		for (size_t i = 0; i < Num; ++i)
+		{
+			const PS2MeshCore::FStripEntry& Entry = Entries[First + i];
+			Positions[i] = Vertices[Entry.Vertex].pos;
+			Positions[i].w = Entry.bADC ? 0.f : 1.f;
+		}
+
+		std::vector<uint32_t> Indices(PS2MeshCore::MaxStripIndices(Num));
+		const size_t NumIndices = PS2MeshCore::DecodeStrips(reinterpret_cast<const uint8_t*>(Positions.data()), sizeof(FSyntheticPS2Mesh::FVector4), Num, RestartMode, Indices.data());
+		for (size_t i = 0; i + 2 < NumIndices; i += 3)
+		{
+			OutTriangles.push_back(CanonicalTriangle(Entries[First + Indices[i]].Vertex, Entries[First + Indices[i + 1]].Vertex, Entries[First + Indices[i + 2]].Vertex));
+		}
+	}
+
+	/**
+	 * Builds strips from a triangle list and checks they decode back to the same triangles with the same winding, both as
+	 * a whole and batch by batch as the runtime uploads them.
+	 *
+	 * @return False on any mismatch.
+	 */
+	static bool CheckStripRoundTrip(const std::vector<uint32_t>& Indices, const std::vector<FVertex>& Vertices, PS2MeshCore::EStripRestartMode RestartMode, size_t BatchSize, PS2MeshCore::FStripBuildStats& OutStats)
+	{
+		std::vector<PS2MeshCore::FStripEntry> Entries;
+		PS2MeshCore::BuildStrips(Indices.data(), Indices.size(), Vertices.size(), RestartMode, BatchSize, Entries, &OutStats);
+
+		std::vector<std::array<uint32_t, 3>> Expected;
+		Expected.reserve(Indices.size() / 3);
+		for (size_t i = 0; i + 2 < Indices.size(); i += 3)
+		{
+			Expected.push_back(CanonicalTriangle(Indices[i], Indices[i + 1], Indices[i + 2]));
+		}
+		std::sort(Expected.begin(), Expected.end());
+
+		std::vector<std::array<uint32_t, 3>> Whole;
+		DecodeStripEntries(Entries, Vertices, 0, Entries.size(), RestartMode, Whole);
+		std::sort(Whole.begin(), Whole.end());
+
+		std::vector<std::array<uint32_t, 3>> Batched;
+		for (size_t First = 0; First < Entries.size(); First += BatchSize)
+		{
+			DecodeStripEntries(Entries, Vertices, First, std::min(BatchSize, Entries.size() - First), RestartMode, Batched);
+		}
+		std::sort(Batched.begin(), Batched.end());
+
+		return Whole == Expected && Batched == Expected;
+	}
+
+	static std::vector<size_t> ParseSizes(const char* Argument)
+	{
+		std::vector<size_t> Sizes;
+		const std::string List(Argument);
+		size_t Start = 0;
+		while (Start < List.size())
+		{
+			const size_t End = std::min(List.find(',', Start), List.size());
+			Sizes.push_back(std::strtoull(List.substr(Start, End - Start).c_str(), nullptr, 10));
+			Start = End + 1;
+		}
+		return Sizes;
+	}
+
+	// Returns the number of strip round trips that didn't give back the triangles they were built from
+	static int32_t RunCase(const FSyntheticPS2MeshOptions& Options, double MinTime)
+	{
+		const FSyntheticPS2Mesh Mesh = GenerateSyntheticPS2Mesh(Options);
+		const size_t NumStripVertices = Mesh.Positions.size();
+
+		// Same conversion as a typical import, scaled up and moved
+		const float Transform[4][4] =
+		{
+			{ 100.f, 0.f, 0.f, 0.f },
+			{ 0.f, 100.f, 0.f, 0.f },
+			{ 0.f, 0.f, 100.f, 0.f },
+			{ 10.f, 20.f, 30.f, 1.f },
+		};
+		const PS2MeshCore::FColorLinearizer ColorLinearizer(2.2f);
+
+		std::vector<FVertex> StripVertices(NumStripVertices);
+		std::vector<uint32_t> StripIndices(PS2MeshCore::MaxStripIndices(NumStripVertices));
+		size_t NumIndices = 0;
+		PS2MeshCore::FStripDecodeStats DecodeStats;
+		std::vector<FVertex> Vertices;
+		std::vector<uint32_t> Indices;
+		size_t NumWeldedVertices = 0;
+		std::vector<float> Positions;
+		std::vector<float> Normals;
+		std::vector<float> Colors;
+
+		std::vector<FStageResult> Results;
+		auto NoSetup = []() {};
+
+		Results.push_back({ "interleave", TimeStage(MinTime, NoSetup, [&]()
+			{
+				// Zeroed first, the translator compares vertices bytewise
+				std::memset(StripVertices.data(), 0, StripVertices.size() * sizeof(FVertex));
+				for (size_t i = 0; i < NumStripVertices; ++i)
+				{
+					StripVertices[i].pos = Mesh.Positions[i];
+					StripVertices[i].nrm = Mesh.Normals[i];
+					StripVertices[i].uvs = Mesh.UVs[i];
+					StripVertices[i].colors = Mesh.Colors[i];
+				}
+			}), NumStripVertices, 0 });
+
+		Results.push_back({ "decode strips", TimeStage(MinTime, NoSetup, [&]()
+			{
+				NumIndices = PS2MeshCore::DecodeStrips(reinterpret_cast<const uint8_t*>(Mesh.Positions.data()), sizeof(FSyntheticPS2Mesh::FVector4), NumStripVertices, Options.RestartMode, StripIndices.data(), &DecodeStats);
+			}), NumStripVertices, NumIndices / 3 });
+		Results.back().NumTriangles = NumIndices / 3;
+
+		Results.push_back({ "weld", TimeStage(MinTime, [&]()
+			{
+				Vertices = StripVertices;
+				Indices.assign(StripIndices.begin(), StripIndices.begin() + NumIndices);
+			},
+			[&]()
+			{
+				NumWeldedVertices = PS2MeshCore::WeldVertices(Vertices.data(), Vertices.size(), sizeof(FVertex), Indices.data(), Indices.size());
+			}), NumStripVertices, NumIndices / 3 });
+		Vertices.resize(NumWeldedVertices);
+
+		Positions.resize(NumWeldedVertices * 3);
+		Normals.resize(NumWeldedVertices * 3);
+		Colors.resize(NumWeldedVertices * 4);
+
+		Results.push_back({ "basis conversion", TimeStage(MinTime, NoSetup, [&]()
+			{
+				const uint8_t* Source = reinterpret_cast<const uint8_t*>(Vertices.data());
+				PS2MeshCore::TransformPositions(Source + offsetof(FVertex, pos), sizeof(FVertex), NumWeldedVertices, Transform, Positions.data());
+				PS2MeshCore::TransformNormals(Source + offsetof(FVertex, nrm), sizeof(FVertex), NumWeldedVertices, Transform, Normals.data());
+			}), NumWeldedVertices, NumIndices / 3 });
+
+		Results.push_back({ "color linearization", TimeStage(MinTime, NoSetup, [&]()
+			{
+				const uint8_t* Source = reinterpret_cast<const uint8_t*>(Vertices.data());
+				ColorLinearizer.LinearizeColors(Source + offsetof(FVertex, colors), sizeof(FVertex), NumWeldedVertices, true, Colors.data());
+			}), NumWeldedVertices, NumIndices / 3 });
+
+		std::printf("%s: %zu strip verts, %zu welded verts, %zu tris (%d degenerate, %d skipped)\n",
+			DescribeSyntheticPS2Mesh(Options).c_str(), NumStripVertices, NumWeldedVertices, NumIndices / 3, DecodeStats.NumDegenerateTriangles, DecodeStats.NumSkippedTriangles);
+
+		double TotalSeconds = 0.;
+		for (const FStageResult& Result : Results)
+		{
+			TotalSeconds += Result.Seconds;
+			std::printf("  %-20s %10.3f ms %12.1f Mverts/s %12.1f Mtris/s\n", Result.Name, Result.Seconds * 1.e3,
+				Result.NumVertices / Result.Seconds * 1.e-6, Result.NumTriangles / Result.Seconds * 1.e-6);
+		}
+		std::printf("  %-20s %10.3f ms %12.1f Mverts/s %12.1f Mtris/s\n", "total", TotalSeconds * 1.e3,
+			NumStripVertices / TotalSeconds * 1.e-6, (NumIndices / 3) / TotalSeconds * 1.e-6);
+
+		// LOD generation is optional in the translator so it's left out of the total
+		std::vector<uint32_t> LODIndices(Indices.size());
+		size_t NumLODIndices = 0;
+		float LODError = 0.f;
+		const double LODSeconds = TimeStage(MinTime, NoSetup, [&]()
+			{
+				NumLODIndices = PS2MeshCore::SimplifyTriangles(Indices.data(), Indices.size(), reinterpret_cast<const uint8_t*>(Vertices.data()) + offsetof(FVertex, pos), sizeof(FVertex), NumWeldedVertices,
+					Indices.size() / 6 * 3, 0.02f, false, LODIndices.data(), &LODError);
+			});
+		std::printf("  %-20s %10.3f ms %12.1f Mverts/s %12.1f Mtris/s  %zu tris, error %g\n", "simplify 50%", LODSeconds * 1.e3,
+			NumWeldedVertices / LODSeconds * 1.e-6, (NumIndices / 3) / LODSeconds * 1.e-6, NumLODIndices / 3, LODError);
+
+		// The default export batch, (496 - 8) / 4 vertices rounded down to even, and the smallest one allowed
+		int32_t NumMismatches = 0;
+		for (const size_t BatchSize : { size_t(122), size_t(8) })
+		{
+			PS2MeshCore::FStripBuildStats StripStats;
+			const bool bMatches = CheckStripRoundTrip(Indices, Vertices, Options.RestartMode, BatchSize, StripStats);
+			NumMismatches += bMatches ? 0 : 1;
+			std::printf("  strip round trip, batches of %zu: %zu strips, %zu batches, %zu entries (%zu extra) %s\n", BatchSize,
+				StripStats.NumStrips, StripStats.NumBatches, StripStats.NumEntries, StripStats.NumExtraEntries, bMatches ? "matches" : "MISMATCH");
+		}
+
+		std::printf("  peak memory %.1f MiB\n\n", GetPeakMemory() / (1024. * 1024.));
+		return NumMismatches;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace PS2MeshImportBenchmark;
+
+	std::vector<size_t> Sizes = { 10000, 100000, 1000000 };
+	double MinTime = 0.25;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--vertices") == 0 && i + 1 < argc)
+		{
+			Sizes = ParseSizes(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+		{
+			MinTime = std::atof(argv[++i]);
+		}
+		else
+		{
+			std::fprintf(stderr, "Usage: %s [--vertices 10000,100000,1000000] [--min-time 0.25]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Long strips covering whole rows, and short ones cut every few quads, each joined both ways
+	const size_t StripLengths[] = { 1u << 20, 8 };
+	const PS2MeshCore::EStripRestartMode RestartModes[] = { PS2MeshCore::EStripRestartMode::None, PS2MeshCore::EStripRestartMode::PositionW };
+
+	int32_t NumMismatches = 0;
+	for (size_t NumVertices : Sizes)
+	{
+		for (size_t QuadsPerStrip : StripLengths)
+		{
+			for (PS2MeshCore::EStripRestartMode RestartMode : RestartModes)
+			{
+				FSyntheticPS2MeshOptions Options;
+				Options.NumVertices = NumVertices;
+				Options.QuadsPerStrip = QuadsPerStrip;
+				Options.RestartMode = RestartMode;
+				NumMismatches += RunCase(Options, MinTime);
+			}
+		}
+	}
+
+	if (NumMismatches > 0)
+	{
+		std::fprintf(stderr, "%d strip round trips didn't decode back to the triangles they were built from\n", NumMismatches);
+		return 1;
+	}
+	return 0;
+}
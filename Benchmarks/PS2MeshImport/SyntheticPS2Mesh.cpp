@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SyntheticPS2Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace SyntheticPS2Mesh
+{
+	struct FGrid
+	{
+		size_t NumColumns;
+		size_t NumRows;
+		std::vector<float> Heights;
+
+		float GetHeight(size_t Column, size_t Row) const { return Heights[Row * (NumColumns + 1) + Column]; }
+	};
+
+	static void AddVertex(FSyntheticPS2Mesh& Mesh, const FGrid& Grid, size_t Column, size_t Row, bool bADC)
+	{
+		const float Height = Grid.GetHeight(Column, Row);
+
+		// Central differences, clamped at the edges
+		const float Left = Grid.GetHeight(Column > 0 ? Column - 1 : Column, Row);
+		const float Right = Grid.GetHeight(std::min(Column + 1, Grid.NumColumns), Row);
+		const float Down = Grid.GetHeight(Column, Row > 0 ? Row - 1 : Row);
+		const float Up = Grid.GetHeight(Column, std::min(Row + 1, Grid.NumRows));
+		float Normal[3] = { Left - Right, 2.f, Down - Up };
+		const float Length = std::sqrt(Normal[0] * Normal[0] + Normal[1] * Normal[1] + Normal[2] * Normal[2]);
+
+		// PS2 basis, Y up. W of zero sets ADC in PositionW mode
+		Mesh.Positions.push_back({ float(Column), Height, float(Row), bADC ? 0.f : 1.f });
+		Mesh.Normals.push_back({ Normal[0] / Length, Normal[1] / Length, Normal[2] / Length, 0.f });
+		Mesh.UVs.push_back({ float(Column) / Grid.NumColumns, float(Row) / Grid.NumRows });
+
+		// PS2 colors go up to 2, 0x80 being full intensity
+		const float Shade = 0.5f + Height * 0.25f;
+		Mesh.Colors.push_back({ Shade, Shade * 0.9f, Shade * 0.8f, 1.f });
+	}
+}
+
+FSyntheticPS2Mesh GenerateSyntheticPS2Mesh(const FSyntheticPS2MeshOptions& Options)
+{
+	using namespace SyntheticPS2Mesh;
+
+	// Each quad adds two strip vertices, plus a couple per strip for joining. Make the grid about square
+	const size_t NumQuads = std::max<size_t>(Options.NumVertices / 2, 1);
+	FGrid Grid;
+	Grid.NumColumns = std::max<size_t>(size_t(std::sqrt(double(NumQuads))), 1);
+	Grid.NumRows = std::max<size_t>(NumQuads / Grid.NumColumns, 1);
+
+	std::mt19937 Random(Options.Seed);
+	std::uniform_real_distribution<float> Noise(-0.25f, 0.25f);
+	Grid.Heights.resize((Grid.NumColumns + 1) * (Grid.NumRows + 1));
+	for (size_t Row = 0; Row <= Grid.NumRows; ++Row)
+	{
+		for (size_t Column = 0; Column <= Grid.NumColumns; ++Column)
+		{
+			Grid.Heights[Row * (Grid.NumColumns + 1) + Column] = std::sin(Column * 0.1f) + std::cos(Row * 0.13f) + Noise(Random);
+		}
+	}
+
+	FSyntheticPS2Mesh Mesh;
+	const size_t ExpectedVertices = Options.NumVertices + Options.NumVertices / std::max<size_t>(Options.QuadsPerStrip, 1) * 4;
+	Mesh.Positions.reserve(ExpectedVertices);
+	Mesh.Normals.reserve(ExpectedVertices);
+	Mesh.UVs.reserve(ExpectedVertices);
+	Mesh.Colors.reserve(ExpectedVertices);
+
+	const size_t QuadsPerStrip = std::max<size_t>(Options.QuadsPerStrip, 1);
+	bool bFirstStrip = true;
+	size_t PreviousColumn = 0;
+	size_t PreviousRow = 0;
+	for (size_t Row = 0; Row < Grid.NumRows; ++Row)
+	{
+		for (size_t FirstColumn = 0; FirstColumn < Grid.NumColumns; FirstColumn += QuadsPerStrip)
+		{
+			const size_t LastColumn = std::min(FirstColumn + QuadsPerStrip, Grid.NumColumns);
+
+			if (!bFirstStrip && Options.RestartMode == PS2MeshCore::EStripRestartMode::None)
+			{
+				// Stitch with degenerate triangles, repeating the last vertex and the first of the next strip. One more
+				// repeat when needed keeps the new strip starting on an even vertex so its winding is the same
+				AddVertex(Mesh, Grid, PreviousColumn, PreviousRow, false);
+				AddVertex(Mesh, Grid, FirstColumn, Row + 1, false);
+				if (Mesh.Positions.size() % 2 != 0)
+				{
+					AddVertex(Mesh, Grid, FirstColumn, Row + 1, false);
+				}
+			}
+
+			for (size_t Column = FirstColumn; Column <= LastColumn; ++Column)
+			{
+				// The first two vertices of a strip have ADC set, which restarts it
+				const bool bADC = Options.RestartMode == PS2MeshCore::EStripRestartMode::PositionW && Column == FirstColumn;
+				AddVertex(Mesh, Grid, Column, Row + 1, bADC);
+				AddVertex(Mesh, Grid, Column, Row, bADC);
+			}
+
+			bFirstStrip = false;
+			PreviousColumn = LastColumn;
+			PreviousRow = Row;
+		}
+	}
+
+	return Mesh;
+}
+
+std::string DescribeSyntheticPS2Mesh(const FSyntheticPS2MeshOptions& Options)
+{
+	std::string Description = std::to_string(Options.NumVertices) + " verts, ";
+	Description += std::to_string(Options.QuadsPerStrip) + " quads/strip, ";
+	Description += Options.RestartMode == PS2MeshCore::EStripRestartMode::PositionW ? "ADC restarts" : "stitched";
+	return Description;
+}
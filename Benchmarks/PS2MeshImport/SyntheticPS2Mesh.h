@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "PS2MeshCore.h"
+
+/**
+ * Generated stand-in for a .mdl file. The arrays have the layout of MeshFileHeader's pos, nrm, uvs and colors, which
+ * are all the import stages read, so the benchmark doesn't need the egg library.
+ *
+ * The mesh is a height field cut into triangle strips along its rows. Neighbouring strips share their edge vertices,
+ * which is what welding merges back together.
+ */
+struct FSyntheticPS2Mesh
+{
+	struct FVector4 { float x, y, z, w; };
+	struct FVector2 { float x, y; };
+
+	std::vector<FVector4> Positions;
+	std::vector<FVector4> Normals;
+	std::vector<FVector2> UVs;
+	std::vector<FVector4> Colors;
+};
+
+struct FSyntheticPS2MeshOptions
+{
+	// Roughly how many strip vertices to generate
+	size_t NumVertices = 100000;
+
+	// Quads per strip before it's cut and a new one started. Long strips run the whole row
+	size_t QuadsPerStrip = 64;
+
+	// How strips are joined, stitched with repeated vertices or restarted with the ADC flag in position W
+	PS2MeshCore::EStripRestartMode RestartMode = PS2MeshCore::EStripRestartMode::None;
+
+	uint32_t Seed = 1;
+};
+
+FSyntheticPS2Mesh GenerateSyntheticPS2Mesh(const FSyntheticPS2MeshOptions& Options);
+
+std::string DescribeSyntheticPS2Mesh(const FSyntheticPS2MeshOptions& Options);
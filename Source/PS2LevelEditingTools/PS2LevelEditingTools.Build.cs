@@ -25,6 +25,10 @@ public class PS2LevelEditingTools : ModuleRules
 				"Slate",
 				"SlateCore",
 				"Foliage",
+				"UnrealEd",
+				"DirectoryWatcher",
+				"DerivedDataCache",
+				"Json",
 
 				"MeshOptimizer",
                 "PS2LevelEditingToolsLibrary"
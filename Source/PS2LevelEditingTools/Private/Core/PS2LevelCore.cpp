@@ -0,0 +1,753 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2LevelCore.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define PS2LEVELCORE_SSE 1
+#else
+#define PS2LEVELCORE_SSE 0
+#endif
+
+static_assert(sizeof(PS2LevelCore::FCompactTransform) == 20, "Compact transforms are packed for the runtime");
+static_assert(sizeof(PS2LevelCore::FMatrix44) == 64, "Exported transforms are written as egg Matrix");
+
+namespace PS2LevelCore
+{
+	// Same tolerance as UE_SMALL_NUMBER, used where the engine's math would
+	constexpr double SmallNumber = 1.e-8;
+
+	constexpr float MaxPosition = 65535.f;
+
+	// The three smallest components of a unit quaternion are within +-1/sqrt(2), they're stored in 15 bits each
+	constexpr float MaxRotation = 32767.f;
+	constexpr float Sqrt2 = 1.4142135623730950488f;
+	constexpr float InvSqrt2 = 0.70710678118654752440f;
+
+	static int32_t RoundToInt(float Value)
+	{
+		return int32_t(std::floor(Value + 0.5f));
+	}
+
+	static uint16_t QuantizeRotation(float Value)
+	{
+		return uint16_t(std::clamp(RoundToInt((Value * Sqrt2 * 0.5f + 0.5f) * MaxRotation), 0, int32_t(MaxRotation)));
+	}
+
+	static float DequantizeRotation(uint16_t Value)
+	{
+		return (float(Value & 0x7fff) / MaxRotation * 2.f - 1.f) * InvSqrt2;
+	}
+
+	// IEEE half, rounded to nearest even. Too large values become infinity
+	static uint16_t FloatToHalf(float Value)
+	{
+		uint32_t Bits;
+		std::memcpy(&Bits, &Value, sizeof(Bits));
+
+		const uint16_t Sign = uint16_t((Bits >> 16) & 0x8000);
+		const uint32_t Magnitude = Bits & 0x7fffffff;
+		if (Magnitude > 0x7f800000)
+		{
+			return Sign | 0x7e00;
+		}
+		if (Magnitude >= 0x47800000)
+		{
+			return Sign | 0x7c00;
+		}
+		if (Magnitude < 0x38800000)
+		{
+			// Subnormal, in steps of 2^-24. Rounding up out of the range gives the smallest normal, which is right
+			float Abs;
+			std::memcpy(&Abs, &Magnitude, sizeof(Abs));
+			return Sign | uint16_t(std::nearbyint(Abs * 16777216.f));
+		}
+
+		// Rebias the exponent from 127 to 15 and round off the low 13 bits of the mantissa, carrying into the exponent
+		uint32_t Half = (Magnitude - 0x38000000) >> 13;
+		const uint32_t Remainder = Magnitude & 0x1fff;
+		if (Remainder > 0x1000 || (Remainder == 0x1000 && (Half & 1) != 0))
+		{
+			Half++;
+		}
+		return Sign | uint16_t(Half);
+	}
+
+	static float HalfToFloat(uint16_t Half)
+	{
+		const uint32_t Sign = uint32_t(Half & 0x8000) << 16;
+		const uint32_t Exponent = (Half >> 10) & 0x1f;
+		const uint32_t Mantissa = Half & 0x3ff;
+
+		if (Exponent == 0)
+		{
+			const float Value = float(Mantissa) * (1.f / 16777216.f);
+			return Sign ? -Value : Value;
+		}
+
+		const uint32_t Bits = Exponent == 0x1f ? Sign | 0x7f800000 | (Mantissa << 13) : Sign | ((Exponent + 112) << 23) | (Mantissa << 13);
+		float Value;
+		std::memcpy(&Value, &Bits, sizeof(Value));
+		return Value;
+	}
+
+	// FTransform::ToMatrixWithScale, for both precisions
+	template<typename T>
+	static void MakeMatrix(const T Rotation[4], const T Translation[3], const T Scale[3], T OutMatrix[4][4])
+	{
+		const T X2 = Rotation[0] + Rotation[0];
+		const T Y2 = Rotation[1] + Rotation[1];
+		const T Z2 = Rotation[2] + Rotation[2];
+
+		const T XX2 = Rotation[0] * X2;
+		const T YY2 = Rotation[1] * Y2;
+		const T ZZ2 = Rotation[2] * Z2;
+		OutMatrix[0][0] = (T(1) - (YY2 + ZZ2)) * Scale[0];
+		OutMatrix[1][1] = (T(1) - (XX2 + ZZ2)) * Scale[1];
+		OutMatrix[2][2] = (T(1) - (XX2 + YY2)) * Scale[2];
+
+		const T YZ2 = Rotation[1] * Z2;
+		const T WX2 = Rotation[3] * X2;
+		OutMatrix[2][1] = (YZ2 - WX2) * Scale[2];
+		OutMatrix[1][2] = (YZ2 + WX2) * Scale[1];
+
+		const T XY2 = Rotation[0] * Y2;
+		const T WZ2 = Rotation[3] * Z2;
+		OutMatrix[1][0] = (XY2 - WZ2) * Scale[1];
+		OutMatrix[0][1] = (XY2 + WZ2) * Scale[0];
+
+		const T XZ2 = Rotation[0] * Z2;
+		const T WY2 = Rotation[3] * Y2;
+		OutMatrix[2][0] = (XZ2 + WY2) * Scale[2];
+		OutMatrix[0][2] = (XZ2 - WY2) * Scale[0];
+
+		OutMatrix[0][3] = T(0);
+		OutMatrix[1][3] = T(0);
+		OutMatrix[2][3] = T(0);
+		OutMatrix[3][0] = Translation[0];
+		OutMatrix[3][1] = Translation[1];
+		OutMatrix[3][2] = Translation[2];
+		OutMatrix[3][3] = T(1);
+	}
+
+	template<typename T>
+	static void NormalizeQuat(T Quat[4])
+	{
+		const T SquareSum = Quat[0] * Quat[0] + Quat[1] * Quat[1] + Quat[2] * Quat[2] + Quat[3] * Quat[3];
+		if (SquareSum >= T(SmallNumber))
+		{
+			const T Scale = T(1) / std::sqrt(SquareSum);
+			for (int32_t Index = 0; Index < 4; ++Index)
+			{
+				Quat[Index] *= Scale;
+			}
+		}
+		else
+		{
+			Quat[0] = Quat[1] = Quat[2] = T(0);
+			Quat[3] = T(1);
+		}
+	}
+
+	static float RowSizeSquared(const float Row[4])
+	{
+		return Row[0] * Row[0] + Row[1] * Row[1] + Row[2] * Row[2];
+	}
+
+	// FTransform3f(Matrix): scale is the length of each row, a negative determinant comes out as a negative X scale
+	static void Decompose(const FMatrix44& Transform, float OutRotation[4], float OutScale[3])
+	{
+		float M[3][4];
+		for (int32_t Row = 0; Row < 3; ++Row)
+		{
+			const float SizeSquared = RowSizeSquared(Transform.M[Row]);
+			OutScale[Row] = 0.f;
+			for (int32_t Column = 0; Column < 4; ++Column)
+			{
+				M[Row][Column] = Transform.M[Row][Column];
+			}
+			if (SizeSquared > float(SmallNumber))
+			{
+				OutScale[Row] = std::sqrt(SizeSquared);
+				const float InvScale = 1.f / OutScale[Row];
+				M[Row][0] *= InvScale;
+				M[Row][1] *= InvScale;
+				M[Row][2] *= InvScale;
+			}
+		}
+
+		const float (&Source)[4][4] = Transform.M;
+		const float Determinant =
+			Source[0][0] * (Source[1][1] * Source[2][2] - Source[1][2] * Source[2][1]) -
+			Source[0][1] * (Source[1][0] * Source[2][2] - Source[1][2] * Source[2][0]) +
+			Source[0][2] * (Source[1][0] * Source[2][1] - Source[1][1] * Source[2][0]);
+		if (Determinant < 0.f)
+		{
+			OutScale[0] = -OutScale[0];
+			M[0][0] = -M[0][0];
+			M[0][1] = -M[0][1];
+			M[0][2] = -M[0][2];
+		}
+
+		// FQuat(Matrix), which gives up on matrices with a missing axis
+		if (RowSizeSquared(M[0]) <= float(SmallNumber) || RowSizeSquared(M[1]) <= float(SmallNumber) || RowSizeSquared(M[2]) <= float(SmallNumber))
+		{
+			OutRotation[0] = OutRotation[1] = OutRotation[2] = 0.f;
+			OutRotation[3] = 1.f;
+			return;
+		}
+
+		const float Trace = M[0][0] + M[1][1] + M[2][2];
+		if (Trace > 0.f)
+		{
+			const float InvS = 1.f / std::sqrt(Trace + 1.f);
+			const float S = 0.5f * InvS;
+			OutRotation[3] = 0.5f * (1.f / InvS);
+			OutRotation[0] = (M[1][2] - M[2][1]) * S;
+			OutRotation[1] = (M[2][0] - M[0][2]) * S;
+			OutRotation[2] = (M[0][1] - M[1][0]) * S;
+		}
+		else
+		{
+			int32_t I = 0;
+			if (M[1][1] > M[0][0])
+			{
+				I = 1;
+			}
+			if (M[2][2] > M[I][I])
+			{
+				I = 2;
+			}
+			static const int32_t Next[3] = { 1, 2, 0 };
+			const int32_t J = Next[I];
+			const int32_t K = Next[J];
+
+			const float InvS = 1.f / std::sqrt(M[I][I] - M[J][J] - M[K][K] + 1.f);
+			const float S = 0.5f * InvS;
+			OutRotation[I] = 0.5f * (1.f / InvS);
+			OutRotation[3] = (M[J][K] - M[K][J]) * S;
+			OutRotation[J] = (M[I][J] + M[J][I]) * S;
+			OutRotation[K] = (M[I][K] + M[K][I]) * S;
+		}
+
+		NormalizeQuat(OutRotation);
+	}
+
+	// Result = A * B, accumulated in the same order as VectorMatrixMultiply so both paths give the same bits
+	static void MultiplyMatrices(const FMatrix44& A, const FMatrix44& B, FMatrix44& Result)
+	{
+#if PS2LEVELCORE_SSE
+		const __m128 B0 = _mm_loadu_ps(B.M[0]);
+		const __m128 B1 = _mm_loadu_ps(B.M[1]);
+		const __m128 B2 = _mm_loadu_ps(B.M[2]);
+		const __m128 B3 = _mm_loadu_ps(B.M[3]);
+
+		for (int32_t Row = 0; Row < 4; ++Row)
+		{
+			__m128 Sum = _mm_mul_ps(_mm_set1_ps(A.M[Row][0]), B0);
+			Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(A.M[Row][1]), B1));
+			Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(A.M[Row][2]), B2));
+			Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(A.M[Row][3]), B3));
+			_mm_storeu_ps(Result.M[Row], Sum);
+		}
+#else
+		for (int32_t Row = 0; Row < 4; ++Row)
+		{
+			for (int32_t Column = 0; Column < 4; ++Column)
+			{
+				float Sum = A.M[Row][0] * B.M[0][Column];
+				Sum += A.M[Row][1] * B.M[1][Column];
+				Sum += A.M[Row][2] * B.M[2][Column];
+				Sum += A.M[Row][3] * B.M[3][Column];
+				Result.M[Row][Column] = Sum;
+			}
+		}
+#endif
+	}
+
+	static FMatrix44 NarrowMatrix(const double Matrix[4][4])
+	{
+		FMatrix44 Result;
+		for (int32_t Row = 0; Row < 4; ++Row)
+		{
+			for (int32_t Column = 0; Column < 4; ++Column)
+			{
+				Result.M[Row][Column] = float(Matrix[Row][Column]);
+			}
+		}
+		return Result;
+	}
+
+	static size_t Align(size_t Value, size_t Alignment)
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	// Bytes of the LevelFileHeader written between progress calls
+	constexpr size_t HeaderChunkSize = size_t(1) << 20;
+
+	// Size of a section as matrices, only used to share out progress between the header and the sections
+	static size_t EstimateSectionSize(const FInstanceGroupsView& Instances)
+	{
+		return Instances.NumGroups * Instances.GroupSize + Instances.NumTransforms * sizeof(FMatrix44);
+	}
+
+	static void PadToAlignment(std::vector<uint8_t>& Out)
+	{
+		Out.resize(Align(Out.size(), SectionAlignment), 0);
+	}
+
+	template<typename T>
+	static void Write(std::vector<uint8_t>& Out, const T& Value)
+	{
+		const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Value);
+		Out.insert(Out.end(), Bytes, Bytes + sizeof(T));
+	}
+
+	static void WriteBytes(std::vector<uint8_t>& Out, const void* Data, size_t Size)
+	{
+		const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+		Out.insert(Out.end(), Bytes, Bytes + Size);
+	}
+
+	static void PadToAlignment(ILevelOutput& Out, int64_t FileStart)
+	{
+		static const uint8_t Zeros[SectionAlignment] = {};
+		const int64_t Position = Out.Tell() - FileStart;
+		Out.Write(Zeros, size_t(Align(size_t(Position), SectionAlignment) - size_t(Position)));
+	}
+
+	static std::vector<uint8_t> SerializeInstanceGroups(const FInstanceGroupsView& Instances, const FLevelWriteOptions& Options, FLevelWriteReport& Report)
+	{
+		std::vector<uint8_t> Section;
+
+		FInstanceGroupsHeader Header;
+		std::memset(&Header, 0, sizeof(Header));
+		Header.NumGroups = uint32_t(Instances.NumGroups);
+		Header.GroupsOffset = uint32_t(Align(sizeof(FInstanceGroupsHeader), SectionAlignment));
+		Header.NumTransforms = uint32_t(Instances.NumTransforms);
+		Header.TransformsOffset = uint32_t(Align(Header.GroupsOffset + Instances.NumGroups * Instances.GroupSize, SectionAlignment));
+		Header.TransformEncoding = uint32_t(ETransformEncoding::Matrix);
+
+		std::vector<FCompactTransform> CompactTransforms;
+		if (Options.TransformEncoding == ETransformEncoding::Compact)
+		{
+			FTransformQuantization Quantization;
+			FTransformEncodingError Error;
+			EncodeTransforms(Instances.Transforms, Instances.NumTransforms, Quantization, CompactTransforms, Error);
+
+			if (Error.MaxPositionError <= Options.MaxPositionError && Error.MaxBasisError <= Options.MaxBasisError)
+			{
+				Header.TransformEncoding = uint32_t(ETransformEncoding::Compact);
+				for (int32_t Axis = 0; Axis < 3; ++Axis)
+				{
+					Header.PositionOrigin[Axis] = Quantization.Origin[Axis];
+					Header.PositionStep[Axis] = Quantization.Step[Axis];
+				}
+
+				Report.NumCompactSections++;
+				Report.NumCompactTransforms += int32_t(Instances.NumTransforms);
+				Report.NumBytesSaved += int64_t(Instances.NumTransforms) * int64_t(sizeof(FMatrix44) - sizeof(FCompactTransform));
+				Report.MaxPositionError = std::max(Report.MaxPositionError, Error.MaxPositionError);
+				Report.MaxBasisError = std::max(Report.MaxBasisError, Error.MaxBasisError);
+			}
+			else
+			{
+				Report.NumRejectedSections++;
+				Report.MaxRejectedPositionError = std::max(Report.MaxRejectedPositionError, Error.MaxPositionError);
+				Report.MaxRejectedBasisError = std::max(Report.MaxRejectedBasisError, Error.MaxBasisError);
+			}
+		}
+
+		const bool bCompact = Header.TransformEncoding == uint32_t(ETransformEncoding::Compact);
+		Section.reserve(Header.TransformsOffset + Instances.NumTransforms * (bCompact ? sizeof(FCompactTransform) : sizeof(FMatrix44)));
+
+		Write(Section, Header);
+		PadToAlignment(Section);
+		WriteBytes(Section, Instances.Groups, Instances.NumGroups * Instances.GroupSize);
+		PadToAlignment(Section);
+		if (bCompact)
+		{
+			WriteBytes(Section, CompactTransforms.data(), CompactTransforms.size() * sizeof(FCompactTransform));
+		}
+		else
+		{
+			WriteBytes(Section, Instances.Transforms, Instances.NumTransforms * sizeof(FMatrix44));
+		}
+
+		return Section;
+	}
+
+	// The cells are written after the directory, so the directory is section FirstCellSection - 1
+	static std::vector<uint8_t> SerializeCellDirectory(const FLevelView& Level, uint32_t FirstCellSection)
+	{
+		std::vector<uint8_t> Section;
+
+		FCellDirectoryHeader Header;
+		Header.NumCells = uint32_t(Level.NumCells);
+		Header.CellsOffset = uint32_t(Align(sizeof(FCellDirectoryHeader), SectionAlignment));
+		Header.CellSize = Level.CellSize;
+		Header.Padding = 0;
+
+		Write(Section, Header);
+		PadToAlignment(Section);
+
+		for (size_t CellIndex = 0; CellIndex < Level.NumCells; ++CellIndex)
+		{
+			const FLevelCellView& CellView = Level.Cells[CellIndex];
+
+			FLevelCell Cell;
+			for (int32_t Axis = 0; Axis < 3; ++Axis)
+			{
+				Cell.BoundsMin[Axis] = CellView.BoundsMin[Axis];
+				Cell.BoundsMax[Axis] = CellView.BoundsMax[Axis];
+			}
+			Cell.SectionIndex = FirstCellSection + uint32_t(CellIndex);
+			Cell.NumTransforms = uint32_t(CellView.Instances.NumTransforms);
+			Write(Section, Cell);
+		}
+
+		return Section;
+	}
+}
+
+void PS2LevelCore::SwitchTransform(FTransform& Transform, EAxis FrontAxis, EAxis RightAxis, EAxis UpAxis)
+{
+	const int32_t Front = int32_t(FrontAxis);
+	const int32_t Right = int32_t(RightAxis);
+	const int32_t Up = int32_t(UpAxis);
+
+	const double NewTranslation[3] = { Transform.Translation[Front], Transform.Translation[Right], Transform.Translation[Up] };
+	const double NewScale[3] = { Transform.Scale[Front], Transform.Scale[Right], Transform.Scale[Up] };
+	double NewRotation[4] = { Transform.Rotation[Front], Transform.Rotation[Right], Transform.Rotation[Up], 0. };
+
+	// Calculate the Levi-Civita symbol for W scaling according to the following table
+	// +1 xyz yzx zxy
+	// -1 xzy yxz zyx
+	// 0 if any axes are duplicated (x == y, y == z, or z == x)
+	double LCSymbol = 0.;
+	if (Front != Right && Right != Up && Up != Front)
+	{
+		LCSymbol = (Right == (Front + 1) % 3) ? 1. : -1.;
+	}
+	NewRotation[3] = Transform.Rotation[3] * LCSymbol;
+
+	NormalizeQuat(NewRotation);
+	std::memcpy(Transform.Rotation, NewRotation, sizeof(NewRotation));
+	std::memcpy(Transform.Translation, NewTranslation, sizeof(NewTranslation));
+	std::memcpy(Transform.Scale, NewScale, sizeof(NewScale));
+}
+
+void PS2LevelCore::MakeMatrixWithScale(const FTransform& Transform, double OutMatrix[4][4])
+{
+	MakeMatrix(Transform.Rotation, Transform.Translation, Transform.Scale, OutMatrix);
+}
+
+PS2LevelCore::FMatrix44 PS2LevelCore::ConvertTransform(const FTransform& Transform)
+{
+	FTransform Switched = Transform;
+	SwitchTransform(Switched, EAxis::X, EAxis::Z, EAxis::Y);
+
+	double Matrix[4][4];
+	MakeMatrixWithScale(Switched, Matrix);
+	return NarrowMatrix(Matrix);
+}
+
+PS2LevelCore::FAxisSwitch::FAxisSwitch(EAxis FrontAxis, EAxis RightAxis, EAxis UpAxis)
+{
+	Axes[0] = int32_t(FrontAxis);
+	Axes[1] = int32_t(RightAxis);
+	Axes[2] = int32_t(UpAxis);
+}
+
+PS2LevelCore::FMatrix44 PS2LevelCore::FAxisSwitch::Apply(const FMatrix44& Matrix) const
+{
+	FMatrix44 Result;
+	for (int32_t Row = 0; Row < 3; ++Row)
+	{
+		for (int32_t Column = 0; Column < 3; ++Column)
+		{
+			Result.M[Row][Column] = Matrix.M[Axes[Row]][Axes[Column]];
+		}
+		Result.M[Row][3] = Matrix.M[Axes[Row]][3];
+	}
+	for (int32_t Column = 0; Column < 3; ++Column)
+	{
+		Result.M[3][Column] = Matrix.M[3][Axes[Column]];
+	}
+	Result.M[3][3] = Matrix.M[3][3];
+	return Result;
+}
+
+void PS2LevelCore::ConvertInstanceTransforms(const uint8_t* Instances, size_t Stride, size_t Num, const FTransform& ComponentTransform, FMatrix44* OutMatrices)
+{
+	const FAxisSwitch AxisSwitch(EAxis::X, EAxis::Z, EAxis::Y);
+
+	// Switch(Instance * Component) == Switch(Instance) * Switch(Component), as the permutation matrix is orthogonal
+	double Component[4][4];
+	MakeMatrixWithScale(ComponentTransform, Component);
+	const FMatrix44 ComponentMatrix = AxisSwitch.Apply(NarrowMatrix(Component));
+
+	for (size_t Index = 0; Index < Num; ++Index)
+	{
+		FMatrix44 Instance;
+		std::memcpy(&Instance, Instances + Index * Stride, sizeof(FMatrix44));
+		MultiplyMatrices(AxisSwitch.Apply(Instance), ComponentMatrix, OutMatrices[Index]);
+	}
+}
+
+PS2LevelCore::FTransformQuantization PS2LevelCore::MakeQuantization(const FMatrix44* Transforms, size_t Num)
+{
+	FTransformQuantization Quantization;
+	if (Num == 0)
+	{
+		return Quantization;
+	}
+
+	float Min[3] = { Transforms[0].M[3][0], Transforms[0].M[3][1], Transforms[0].M[3][2] };
+	float Max[3] = { Min[0], Min[1], Min[2] };
+	for (size_t Index = 1; Index < Num; ++Index)
+	{
+		for (int32_t Axis = 0; Axis < 3; ++Axis)
+		{
+			Min[Axis] = std::min(Min[Axis], Transforms[Index].M[3][Axis]);
+			Max[Axis] = std::max(Max[Axis], Transforms[Index].M[3][Axis]);
+		}
+	}
+
+	for (int32_t Axis = 0; Axis < 3; ++Axis)
+	{
+		Quantization.Origin[Axis] = Min[Axis];
+		Quantization.Step[Axis] = (Max[Axis] - Min[Axis]) / MaxPosition;
+	}
+	return Quantization;
+}
+
+PS2LevelCore::FCompactTransform PS2LevelCore::EncodeTransform(const FMatrix44& Transform, const FTransformQuantization& Quantization)
+{
+	FCompactTransform Compact;
+
+	for (int32_t Axis = 0; Axis < 3; ++Axis)
+	{
+		const float Position = Transform.M[3][Axis] - Quantization.Origin[Axis];
+		const float Quantized = Quantization.Step[Axis] > 0.f ? Position / Quantization.Step[Axis] : 0.f;
+		Compact.Position[Axis] = uint16_t(std::clamp(RoundToInt(Quantized), 0, int32_t(MaxPosition)));
+	}
+
+	float Rotation[4];
+	float Scale[3];
+	Decompose(Transform, Rotation, Scale);
+
+	// Smallest three: drop the largest component, it's recovered from the others as the quaternion is unit length
+	int32_t Largest = 0;
+	for (int32_t Index = 1; Index < 4; ++Index)
+	{
+		if (std::abs(Rotation[Index]) > std::abs(Rotation[Largest]))
+		{
+			Largest = Index;
+		}
+	}
+
+	// q and -q are the same rotation, flip it so the dropped component is positive
+	const float Sign = Rotation[Largest] < 0.f ? -1.f : 1.f;
+	int32_t Stored = 0;
+	for (int32_t Index = 0; Index < 4; ++Index)
+	{
+		if (Index != Largest)
+		{
+			Compact.Rotation[Stored++] = QuantizeRotation(Rotation[Index] * Sign);
+		}
+	}
+	Compact.Rotation[0] |= uint16_t((Largest & 1) << 15);
+	Compact.Rotation[1] |= uint16_t((Largest >> 1) << 15);
+
+	for (int32_t Axis = 0; Axis < 3; ++Axis)
+	{
+		Compact.Scale[Axis] = FloatToHalf(Scale[Axis]);
+	}
+
+	Compact.Padding = 0;
+	return Compact;
+}
+
+PS2LevelCore::FMatrix44 PS2LevelCore::DecodeTransform(const FCompactTransform& Compact, const FTransformQuantization& Quantization)
+{
+	float Position[3];
+	for (int32_t Axis = 0; Axis < 3; ++Axis)
+	{
+		Position[Axis] = Quantization.Origin[Axis] + float(Compact.Position[Axis]) * Quantization.Step[Axis];
+	}
+
+	const int32_t Largest = (Compact.Rotation[0] >> 15) | ((Compact.Rotation[1] >> 15) << 1);
+	float Rotation[4];
+	float SumSquares = 0.f;
+	int32_t Stored = 0;
+	for (int32_t Index = 0; Index < 4; ++Index)
+	{
+		if (Index != Largest)
+		{
+			Rotation[Index] = DequantizeRotation(Compact.Rotation[Stored++]);
+			SumSquares += Rotation[Index] * Rotation[Index];
+		}
+	}
+	Rotation[Largest] = std::sqrt(std::max(0.f, 1.f - SumSquares));
+	NormalizeQuat(Rotation);
+
+	float Scale[3];
+	for (int32_t Axis = 0; Axis < 3; ++Axis)
+	{
+		Scale[Axis] = HalfToFloat(Compact.Scale[Axis]);
+	}
+
+	FMatrix44 Result;
+	MakeMatrix(Rotation, Position, Scale, Result.M);
+	return Result;
+}
+
+void PS2LevelCore::EncodeTransforms(const FMatrix44* Transforms, size_t Num, FTransformQuantization& OutQuantization, std::vector<FCompactTransform>& OutTransforms, FTransformEncodingError& OutError)
+{
+	OutQuantization = MakeQuantization(Transforms, Num);
+
+	OutTransforms.resize(Num);
+	for (size_t Index = 0; Index < Num; ++Index)
+	{
+		const FMatrix44& Source = Transforms[Index];
+		OutTransforms[Index] = EncodeTransform(Source, OutQuantization);
+
+		const FMatrix44 Decoded = DecodeTransform(OutTransforms[Index], OutQuantization);
+		float PositionErrorSquared = 0.f;
+		for (int32_t Axis = 0; Axis < 3; ++Axis)
+		{
+			const float Difference = Source.M[3][Axis] - Decoded.M[3][Axis];
+			PositionErrorSquared += Difference * Difference;
+		}
+		OutError.MaxPositionError = std::max(OutError.MaxPositionError, std::sqrt(PositionErrorSquared));
+
+		float MaxRowLength = float(SmallNumber);
+		float MaxDifference = 0.f;
+		for (int32_t Row = 0; Row < 3; ++Row)
+		{
+			MaxRowLength = std::max(MaxRowLength, std::sqrt(RowSizeSquared(Source.M[Row])));
+			for (int32_t Column = 0; Column < 3; ++Column)
+			{
+				MaxDifference = std::max(MaxDifference, std::abs(Source.M[Row][Column] - Decoded.M[Row][Column]));
+			}
+		}
+		OutError.MaxBasisError = std::max(OutError.MaxBasisError, MaxDifference / MaxRowLength);
+	}
+}
+
+bool PS2LevelCore::WriteLevel(const FLevelView& Level, ILevelOutput& Out, const FLevelWriteOptions& Options, FLevelWriteReport* OutReport, const std::function<bool(float)>& Progress)
+{
+	FLevelWriteReport Report;
+	struct FReportOnExit
+	{
+		const FLevelWriteReport& Report;
+		FLevelWriteReport* OutReport;
+		~FReportOnExit()
+		{
+			if (OutReport)
+			{
+				*OutReport = Report;
+			}
+		}
+	} ReportOnExit{ Report, OutReport };
+
+	size_t EstimatedSectionsSize = EstimateSectionSize(Level.Instances);
+	for (size_t CellIndex = 0; CellIndex < Level.NumCells; ++CellIndex)
+	{
+		EstimatedSectionsSize += EstimateSectionSize(Level.Cells[CellIndex].Instances);
+	}
+	const double HeaderShare = Level.HeaderSize > 0 ? double(Level.HeaderSize) / double(Level.HeaderSize + EstimatedSectionsSize) : 0.0;
+
+	// The header can hold every mesh of an unpartitioned level, so it's written a chunk at a time to be cancellable too
+	const int64_t FileStart = Out.Tell();
+	for (size_t HeaderWritten = 0; HeaderWritten < Level.HeaderSize;)
+	{
+		const size_t ChunkSize = std::min(HeaderChunkSize, Level.HeaderSize - HeaderWritten);
+		Out.Write(static_cast<const uint8_t*>(Level.Header) + HeaderWritten, ChunkSize);
+		HeaderWritten += ChunkSize;
+
+		if (!Progress(float(HeaderShare * HeaderWritten / Level.HeaderSize)) || Out.IsError())
+		{
+			return false;
+		}
+	}
+
+	// Sections are serialized one at a time as they're written, so only one is ever held in memory
+	struct FPendingSection
+	{
+		uint32_t Tag;
+		std::function<std::vector<uint8_t>()> Serialize;
+	};
+	std::vector<FPendingSection> Sections;
+
+	if (Level.Instances.NumGroups > 0)
+	{
+		Sections.push_back({ InstanceGroupsTag, [&]() { return SerializeInstanceGroups(Level.Instances, Options, Report); } });
+	}
+
+	if (Level.NumCells > 0)
+	{
+		const uint32_t FirstCellSection = uint32_t(Sections.size()) + 1;
+		Sections.push_back({ CellDirectoryTag, [&Level, FirstCellSection]() { return SerializeCellDirectory(Level, FirstCellSection); } });
+		for (size_t CellIndex = 0; CellIndex < Level.NumCells; ++CellIndex)
+		{
+			const FLevelCellView& Cell = Level.Cells[CellIndex];
+			Sections.push_back({ CellTag, [&Cell, &Options, &Report]() { return SerializeInstanceGroups(Cell.Instances, Options, Report); } });
+		}
+	}
+
+	if (Sections.empty())
+	{
+		// Nothing the LevelFileHeader can't hold, keep the file readable by loaders that predate the extension block
+		return Progress(1.f) && !Out.IsError();
+	}
+
+	PadToAlignment(Out, FileStart);
+	const int64_t ExtensionStart = Out.Tell();
+
+	FLevelExtensionHeader ExtensionHeader;
+	ExtensionHeader.Magic = ExtensionMagic;
+	ExtensionHeader.Version = ExtensionVersion;
+	ExtensionHeader.NumSections = uint32_t(Sections.size());
+	ExtensionHeader.Padding = 0;
+	Out.Write(&ExtensionHeader, sizeof(ExtensionHeader));
+
+	// The section table is filled in once the size of every section is known
+	const int64_t SectionTableStart = Out.Tell();
+	std::vector<FLevelSection> SectionTable(Sections.size(), FLevelSection{ 0, 0, 0, 0 });
+	Out.Write(SectionTable.data(), SectionTable.size() * sizeof(FLevelSection));
+
+	for (size_t SectionIndex = 0; SectionIndex < Sections.size(); ++SectionIndex)
+	{
+		PadToAlignment(Out, FileStart);
+
+		const std::vector<uint8_t> Data = Sections[SectionIndex].Serialize();
+		SectionTable[SectionIndex].Tag = Sections[SectionIndex].Tag;
+		SectionTable[SectionIndex].Offset = uint32_t(Out.Tell() - ExtensionStart);
+		SectionTable[SectionIndex].Size = uint32_t(Data.size());
+		Out.Write(Data.data(), Data.size());
+
+		if (!Progress(float(HeaderShare + (1.0 - HeaderShare) * (SectionIndex + 1) / Sections.size())) || Out.IsError())
+		{
+			return false;
+		}
+	}
+
+	const int64_t FileEnd = Out.Tell();
+	Out.Seek(SectionTableStart);
+	Out.Write(SectionTable.data(), SectionTable.size() * sizeof(FLevelSection));
+	Out.Seek(FileEnd);
+
+	FLevelFooter Footer;
+	Footer.ExtensionOffset = uint32_t(ExtensionStart - FileStart);
+	Footer.Magic = ExtensionMagic;
+	Out.Write(&Footer, sizeof(Footer));
+
+	return !Out.IsError();
+}
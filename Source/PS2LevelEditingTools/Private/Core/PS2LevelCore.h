@@ -0,0 +1,402 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The data processing stages of a map export, without any engine types so they can also be built and benchmarked as a
+ * plain C++ program (see Benchmarks/PS2LevelExport). The map export converts component transforms and groups foliage
+ * through these, and SerializePS2Level writes the extension block with WriteLevel.
+ *
+ * Layout of a .lvl file:
+ *
+ *   LevelFileHeader (egg serializer)
+ *   padding to 16 bytes
+ *   FLevelExtensionHeader
+ *   FLevelSection[NumSections]
+ *   section data, each section aligned to 16 bytes
+ *   FLevelFooter
+ *
+ * The LevelFileHeader holds the flat list of mesh references and transforms, anything it can't express goes in the
+ * extension block. The footer is always the last 8 bytes of the file so the runtime can find the extension block without
+ * knowing the size of the serialized LevelFileHeader. Files without the footer have no extension block. All offsets are
+ * in bytes from the start of the extension header and everything is little endian.
+ *
+ * Version 2 added the transform encoding to FInstanceGroupsHeader.
+ */
+namespace PS2LevelCore
+{
+	constexpr uint32_t MakeTag(char A, char B, char C, char D)
+	{
+		return uint32_t(uint8_t(A)) | (uint32_t(uint8_t(B)) << 8) | (uint32_t(uint8_t(C)) << 16) | (uint32_t(uint8_t(D)) << 24);
+	}
+
+	constexpr uint32_t ExtensionMagic = MakeTag('P', 'S', '2', 'X');
+	constexpr uint32_t ExtensionVersion = 2;
+
+	// Section holding instanced meshes grouped by mesh, see FInstanceGroupsHeader
+	constexpr uint32_t InstanceGroupsTag = MakeTag('I', 'N', 'S', 'T');
+
+	// Directory of the spatial cells in a partitioned level, see FCellDirectoryHeader
+	constexpr uint32_t CellDirectoryTag = MakeTag('C', 'D', 'I', 'R');
+
+	// The meshes in one spatial cell, laid out the same as an instance groups section
+	constexpr uint32_t CellTag = MakeTag('C', 'E', 'L', 'L');
+
+	constexpr uint32_t SectionAlignment = 16;
+
+	/** Row major matrix that multiplies row vectors, the layout of FMatrix44f and the egg library's Matrix. */
+	struct FMatrix44
+	{
+		float M[4][4];
+	};
+
+	/** Same values as EPS2TransformEncoding. */
+	enum class ETransformEncoding : uint32_t
+	{
+		Matrix,
+		Compact
+	};
+
+	struct FLevelExtensionHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumSections;
+		uint32_t Padding;
+	};
+
+	struct FLevelSection
+	{
+		uint32_t Tag;
+		uint32_t Offset;
+		uint32_t Size;
+		uint32_t Padding;
+	};
+
+	struct FLevelFooter
+	{
+		// Offset of the FLevelExtensionHeader from the start of the file
+		uint32_t ExtensionOffset;
+		uint32_t Magic;
+	};
+
+	/**
+	 * Instanced meshes, typically foliage. Each mesh is stored once along with the range of the transform block holding
+	 * its instances, so the runtime can draw a mesh's instances in one batch.
+	 *
+	 *   FInstanceGroupsHeader
+	 *   TInstanceGroup[NumGroups], at GroupsOffset
+	 *   FMatrix44[NumTransforms] or FCompactTransform[NumTransforms], at TransformsOffset
+	 *
+	 * Offsets are from the start of the section.
+	 */
+	struct FInstanceGroupsHeader
+	{
+		uint32_t NumGroups;
+		uint32_t GroupsOffset;
+		uint32_t NumTransforms;
+		uint32_t TransformsOffset;
+
+		// ETransformEncoding of the transform block
+		uint32_t TransformEncoding;
+
+		// Compact positions are PositionOrigin + Position * PositionStep, unused for matrices
+		float PositionOrigin[3];
+		float PositionStep[3];
+		uint32_t Padding;
+	};
+
+	/** One mesh's instances in an instance groups section. ReferenceType is Asset::Reference in the editor. */
+	template<typename ReferenceType>
+	struct TInstanceGroup
+	{
+		ReferenceType Mesh;
+		uint32_t FirstTransform;
+		uint32_t NumTransforms;
+	};
+
+	/**
+	 * A transform in 20 bytes instead of 64. The rotation is the smallest three components of the quaternion in 15 bits
+	 * each, the index of the dropped component is in the top bits of Rotation[0] (low bit) and Rotation[1] (high bit) and
+	 * it's always positive. Scale is half floats.
+	 */
+	struct FCompactTransform
+	{
+		uint16_t Position[3];
+		uint16_t Rotation[3];
+		uint16_t Scale[3];
+		uint16_t Padding;
+	};
+
+	/**
+	 * A partitioned level has every mesh in a cell and nothing in the LevelFileHeader or an instance groups section. The
+	 * directory lists the bounds of each cell and which section holds it, so the runtime can cull cells against the
+	 * frustum and only keep the sections for nearby cells in memory. Each cell section has the same layout as an instance
+	 * groups section, with transforms in level space.
+	 *
+	 *   FCellDirectoryHeader
+	 *   FLevelCell[NumCells], at CellsOffset
+	 */
+	struct FCellDirectoryHeader
+	{
+		uint32_t NumCells;
+		uint32_t CellsOffset;
+		float CellSize;
+		uint32_t Padding;
+	};
+
+	struct FLevelCell
+	{
+		// Level space bounds of every mesh in the cell, which can reach outside of the cell's grid square
+		float BoundsMin[3];
+		float BoundsMax[3];
+
+		// Index of the CELL section in the extension section table
+		uint32_t SectionIndex;
+		uint32_t NumTransforms;
+	};
+
+	/** A component's transform as FTransform holds it, the rotation is a quaternion (x, y, z, w). */
+	struct FTransform
+	{
+		double Rotation[4];
+		double Translation[3];
+		double Scale[3];
+	};
+
+	enum class EAxis : uint8_t
+	{
+		X,
+		Y,
+		Z
+	};
+
+	/** Swaps the axes of a transform's location, scale and rotation, flipping W when the swap changes handedness. */
+	void SwitchTransform(FTransform& Transform, EAxis FrontAxis, EAxis RightAxis, EAxis UpAxis);
+
+	/** Same as FTransform::ToMatrixWithScale. */
+	void MakeMatrixWithScale(const FTransform& Transform, double OutMatrix[4][4]);
+
+	/** Switches a component transform to the PS2 basis (Y up) and narrows it to the float matrix the file holds. */
+	FMatrix44 ConvertTransform(const FTransform& Transform);
+
+	/**
+	 * SwitchTransform for whole matrices. Swapping the axes of a location, scale and rotation (flipping W when the swap
+	 * changes handedness) is the same as conjugating the matrix by the axis permutation, which only moves elements
+	 * around. The permutation is worked out once and applied to any number of matrices.
+	 */
+	struct FAxisSwitch
+	{
+		int32_t Axes[3];
+
+		FAxisSwitch(EAxis FrontAxis, EAxis RightAxis, EAxis UpAxis);
+
+		FMatrix44 Apply(const FMatrix44& Matrix) const;
+	};
+
+	/**
+	 * Converts instances of an instanced component to PS2 matrices in one pass. The component matrix is switched once,
+	 * after which each instance only needs its own elements moved around and one matrix multiply. Each instance element
+	 * starts with its FMatrix44 relative to the component.
+	 */
+	void ConvertInstanceTransforms(const uint8_t* Instances, size_t Stride, size_t Num, const FTransform& ComponentTransform, FMatrix44* OutMatrices);
+
+	/** A run of instances of one mesh, as collected from one component. */
+	template<typename ReferenceType>
+	struct TInstanceBatch
+	{
+		ReferenceType Mesh;
+		const FMatrix44* Transforms;
+		size_t NumTransforms;
+	};
+
+	/** Hashes the bytes of a reference, references are plain data. */
+	struct FReferenceHash
+	{
+		template<typename ReferenceType>
+		size_t operator()(const ReferenceType& Reference) const
+		{
+			// FNV-1a
+			uint64_t Hash = 0xcbf29ce484222325ull;
+			const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Reference);
+			for (size_t Index = 0; Index < sizeof(ReferenceType); ++Index)
+			{
+				Hash = (Hash ^ Bytes[Index]) * 0x100000001b3ull;
+			}
+			return size_t(Hash);
+		}
+	};
+
+	/**
+	 * Groups instances by mesh, so every mesh is stored once and its instances are contiguous. Groups are in the order
+	 * their mesh first appears and each group's FirstTransform is set, NumTransforms is the group's total. Groups are
+	 * zeroed before they're filled in so the padding written out with them is deterministic.
+	 *
+	 * @param OutBatchGroups	The group each batch belongs to, for CopyGroupedInstances.
+	 * @return The number of transforms in all of the groups.
+	 */
+	template<typename ReferenceType>
+	size_t GroupInstances(const TInstanceBatch<ReferenceType>* Batches, size_t NumBatches, std::vector<TInstanceGroup<ReferenceType>>& OutGroups, std::vector<uint32_t>& OutBatchGroups)
+	{
+		std::unordered_map<ReferenceType, uint32_t, FReferenceHash> GroupIndices;
+		OutBatchGroups.resize(NumBatches);
+
+		for (size_t BatchIndex = 0; BatchIndex < NumBatches; ++BatchIndex)
+		{
+			const TInstanceBatch<ReferenceType>& Batch = Batches[BatchIndex];
+			auto Inserted = GroupIndices.emplace(Batch.Mesh, uint32_t(OutGroups.size()));
+			if (Inserted.second)
+			{
+				TInstanceGroup<ReferenceType> Group;
+				std::memset(&Group, 0, sizeof(Group));
+				Group.Mesh = Batch.Mesh;
+				OutGroups.push_back(Group);
+			}
+
+			OutBatchGroups[BatchIndex] = Inserted.first->second;
+			OutGroups[Inserted.first->second].NumTransforms += uint32_t(Batch.NumTransforms);
+		}
+
+		size_t FirstTransform = 0;
+		for (TInstanceGroup<ReferenceType>& Group : OutGroups)
+		{
+			Group.FirstTransform = uint32_t(FirstTransform);
+			FirstTransform += Group.NumTransforms;
+		}
+		return FirstTransform;
+	}
+
+	/** Copies each batch's transforms into its group's range, keeping the instances within a group in batch order. */
+	template<typename ReferenceType>
+	void CopyGroupedInstances(const TInstanceBatch<ReferenceType>* Batches, size_t NumBatches, const uint32_t* BatchGroups, const std::vector<TInstanceGroup<ReferenceType>>& Groups, FMatrix44* OutTransforms)
+	{
+		std::vector<uint32_t> NextTransforms(Groups.size());
+		for (size_t GroupIndex = 0; GroupIndex < Groups.size(); ++GroupIndex)
+		{
+			NextTransforms[GroupIndex] = Groups[GroupIndex].FirstTransform;
+		}
+
+		for (size_t BatchIndex = 0; BatchIndex < NumBatches; ++BatchIndex)
+		{
+			const TInstanceBatch<ReferenceType>& Batch = Batches[BatchIndex];
+			uint32_t& NextTransform = NextTransforms[BatchGroups[BatchIndex]];
+			std::memcpy(OutTransforms + NextTransform, Batch.Transforms, Batch.NumTransforms * sizeof(FMatrix44));
+			NextTransform += uint32_t(Batch.NumTransforms);
+		}
+	}
+
+	/** Positions in a compact section are stored as Origin + Quantized * Step, with one step per axis. */
+	struct FTransformQuantization
+	{
+		float Origin[3] = {};
+		float Step[3] = {};
+	};
+
+	/** Largest difference between a set of transforms and what they decode to. */
+	struct FTransformEncodingError
+	{
+		// Distance between the source and decoded translation, in level units
+		float MaxPositionError = 0.f;
+
+		// Largest difference in the rotation and scale rows, relative to the largest row of the source
+		float MaxBasisError = 0.f;
+	};
+
+	/** Quantization covering the translation of every transform, using the full 16 bits on each axis. */
+	FTransformQuantization MakeQuantization(const FMatrix44* Transforms, size_t Num);
+
+	FCompactTransform EncodeTransform(const FMatrix44& Transform, const FTransformQuantization& Quantization);
+	FMatrix44 DecodeTransform(const FCompactTransform& Transform, const FTransformQuantization& Quantization);
+
+	/** Encodes transforms with the quantization that fits them best and measures the error of the result. */
+	void EncodeTransforms(const FMatrix44* Transforms, size_t Num, FTransformQuantization& OutQuantization, std::vector<FCompactTransform>& OutTransforms, FTransformEncodingError& OutError);
+
+	struct FLevelWriteOptions
+	{
+		ETransformEncoding TransformEncoding = ETransformEncoding::Matrix;
+
+		// Sections with more error than this are stored as matrices even when compact transforms are asked for
+		float MaxPositionError = 0.f;
+		float MaxBasisError = 0.f;
+	};
+
+	/** What happened to the transforms while writing a level. */
+	struct FLevelWriteReport
+	{
+		int32_t NumCompactSections = 0;
+
+		// Sections stored as matrices because compact transforms were over the error limits
+		int32_t NumRejectedSections = 0;
+
+		int32_t NumCompactTransforms = 0;
+		int64_t NumBytesSaved = 0;
+
+		// Largest error in the sections that were written compact, and in those that were rejected
+		float MaxPositionError = 0.f;
+		float MaxBasisError = 0.f;
+		float MaxRejectedPositionError = 0.f;
+		float MaxRejectedBasisError = 0.f;
+	};
+
+	/** Where a level is written. Seek is only used to go back and fill in the section table. */
+	class ILevelOutput
+	{
+	public:
+		virtual ~ILevelOutput() = default;
+
+		virtual void Write(const void* Data, size_t Size) = 0;
+		virtual int64_t Tell() const = 0;
+		virtual void Seek(int64_t Position) = 0;
+		virtual bool IsError() const = 0;
+	};
+
+	/** The contents of an instance groups or cell section. Groups are TInstanceGroup records, which are written as is. */
+	struct FInstanceGroupsView
+	{
+		const void* Groups = nullptr;
+		size_t NumGroups = 0;
+		size_t GroupSize = 0;
+
+		const FMatrix44* Transforms = nullptr;
+		size_t NumTransforms = 0;
+	};
+
+	struct FLevelCellView
+	{
+		float BoundsMin[3];
+		float BoundsMax[3];
+		FInstanceGroupsView Instances;
+	};
+
+	/** Everything written to a .lvl file, pointing into the caller's arrays. */
+	struct FLevelView
+	{
+		// The serialized LevelFileHeader, written first as is
+		const void* Header = nullptr;
+		size_t HeaderSize = 0;
+
+		FInstanceGroupsView Instances;
+
+		// Spatial cells, only used by partitioned levels
+		float CellSize = 0.f;
+		const FLevelCellView* Cells = nullptr;
+		size_t NumCells = 0;
+	};
+
+	/**
+	 * Writes a level as a .lvl file. The header is written in chunks and the extension block a section at a time, so
+	 * memory use stays around the size of the header and the largest section rather than the whole file.
+	 *
+	 * @param Progress	Called after each chunk of the header and each section with the estimated fraction of the file
+	 *					written. Return false to stop writing.
+	 * @return False if writing was stopped or the output failed, in which case the output holds a partial file.
+	 */
+	bool WriteLevel(const FLevelView& Level, ILevelOutput& Out, const FLevelWriteOptions& Options, FLevelWriteReport* OutReport, const std::function<bool(float)>& Progress);
+}
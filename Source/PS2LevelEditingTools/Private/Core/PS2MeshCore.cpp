@@ -0,0 +1,469 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2MeshCore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define PS2MESHCORE_SSE 1
+#else
+#define PS2MESHCORE_SSE 0
+#endif
+
+#include "meshoptimizer.h"
+
+namespace PS2MeshCore
+{
+	// Smallest cross product, relative to the edge lengths, of a triangle that still has an area
+	constexpr float DegenerateThreshold = 1.e-8f;
+
+	static const float* GetElement(const uint8_t* Source, size_t Stride, size_t Index)
+	{
+		return reinterpret_cast<const float*>(Source + Index * Stride);
+	}
+
+	static bool IsADCSet(const float* Position, EStripRestartMode RestartMode)
+	{
+		switch (RestartMode)
+		{
+		case EStripRestartMode::PositionW:	return Position[3] == 0.f;
+		default:							return false;
+		}
+	}
+
+	static bool IsDegenerate(const float* A, const float* B, const float* C)
+	{
+		const float AB[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+		const float AC[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+		const float Cross[3] =
+		{
+			AB[1] * AC[2] - AB[2] * AC[1],
+			AB[2] * AC[0] - AB[0] * AC[2],
+			AB[0] * AC[1] - AB[1] * AC[0],
+		};
+
+		// Compared against the edge lengths so the test doesn't depend on the scale of the model. This also catches
+		// repeated vertices, which have a zero length edge
+		const float CrossSizeSquared = Cross[0] * Cross[0] + Cross[1] * Cross[1] + Cross[2] * Cross[2];
+		const float ABSizeSquared = AB[0] * AB[0] + AB[1] * AB[1] + AB[2] * AB[2];
+		const float ACSizeSquared = AC[0] * AC[0] + AC[1] * AC[1] + AC[2] * AC[2];
+		return CrossSizeSquared <= DegenerateThreshold * ABSizeSquared * ACSizeSquared;
+	}
+
+	// Out = X * Rows[0] + Y * Rows[1] + Z * Rows[2] + Rows[3] for every element
+	static void TransformElements(const uint8_t* Source, size_t Stride, size_t Num, const float Rows[4][4], float* Out)
+	{
+#if PS2MESHCORE_SSE
+		const __m128 Row0 = _mm_loadu_ps(Rows[0]);
+		const __m128 Row1 = _mm_loadu_ps(Rows[1]);
+		const __m128 Row2 = _mm_loadu_ps(Rows[2]);
+		const __m128 Row3 = _mm_loadu_ps(Rows[3]);
+
+		for (size_t Index = 0; Index < Num; ++Index)
+		{
+			const float* In = GetElement(Source, Stride, Index);
+
+			__m128 Result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(In[0]), Row0), Row3);
+			Result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(In[1]), Row1), Result);
+			Result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(In[2]), Row2), Result);
+
+			// Three floats, the output isn't padded
+			float* OutElement = Out + Index * 3;
+			_mm_storel_pi(reinterpret_cast<__m64*>(OutElement), Result);
+			_mm_store_ss(OutElement + 2, _mm_movehl_ps(Result, Result));
+		}
+#else
+		for (size_t Index = 0; Index < Num; ++Index)
+		{
+			const float* In = GetElement(Source, Stride, Index);
+			float* OutElement = Out + Index * 3;
+			for (int32_t Axis = 0; Axis < 3; ++Axis)
+			{
+				OutElement[Axis] = In[0] * Rows[0][Axis] + In[1] * Rows[1][Axis] + In[2] * Rows[2][Axis] + Rows[3][Axis];
+			}
+		}
+#endif
+	}
+
+	static void LoadRow(const float Matrix[4][4], int32_t Row, float Scale, float OutRow[4])
+	{
+		OutRow[0] = Matrix[Row][0] * Scale;
+		OutRow[1] = Matrix[Row][1] * Scale;
+		OutRow[2] = Matrix[Row][2] * Scale;
+		OutRow[3] = 0.f;
+	}
+
+	// Writes strips into a stream in the layout DecodeStrips and the runtime read, see BuildStrips. A piece is a strip,
+	// or the part of one that fits in a batch, and Offset is where it starts in its strip, which sets its winding
+	class FStripWriter
+	{
+	public:
+		FStripWriter(std::vector<FStripEntry>& InEntries, EStripRestartMode InRestartMode, size_t InBatchSize)
+			: Entries(InEntries)
+			, RestartMode(InRestartMode)
+			, BatchSize(InBatchSize)
+		{
+		}
+
+		void WriteStrip(const uint32_t* Strip, size_t Num, size_t& NumExtraEntries)
+		{
+			size_t Offset = 0;
+			for (;;)
+			{
+				const size_t Extra = GetNumPieceExtraEntries(Offset);
+				const size_t Room = GetRoomInBatch();
+				if (Room < Extra + 3)
+				{
+					NumExtraEntries += PadBatch();
+					continue;
+				}
+
+				const size_t NumPieceVertices = std::min(Num - Offset, Room - Extra);
+				WritePiece(Strip + Offset, NumPieceVertices, Offset);
+				NumExtraEntries += Extra;
+				if (Offset + NumPieceVertices == Num)
+				{
+					return;
+				}
+
+				// Carry on in the next batch from the last two vertices written
+				Offset += NumPieceVertices - 2;
+				NumExtraEntries += 2;
+			}
+		}
+
+		size_t PadBatch()
+		{
+			const size_t Room = GetRoomInBatch();
+			if (Entries.empty() || BatchSize == 0 || Room == BatchSize)
+			{
+				return 0;
+			}
+
+			// Repeats of the last vertex only make triangles with no area. They don't set ADC, which would join up with
+			// a restart that follows and move the start of its strip
+			const uint32_t Last = Entries.back().Vertex;
+			for (size_t Index = 0; Index < Room; ++Index)
+			{
+				Entries.push_back({ Last, false });
+			}
+			return Room;
+		}
+
+	private:
+		size_t GetRoomInBatch() const
+		{
+			return BatchSize == 0 ? SIZE_MAX : BatchSize - Entries.size() % BatchSize;
+		}
+
+		// How many copies of a piece's first vertex put its last copy where the first triangle gets the winding it has
+		// in the strip. With stitching the winding goes by the position in the stream, and at least two copies are
+		// needed after other strips so the triangles joining them repeat a vertex
+		size_t GetNumFirstVertexCopies(size_t Offset) const
+		{
+			const size_t Position = Entries.size() + (Entries.empty() ? 0 : 1);
+			size_t NumCopies = Entries.empty() ? 1 : 2;
+			if (((Position + NumCopies - 1) & 1) != (Offset & 1))
+			{
+				NumCopies++;
+			}
+			return NumCopies;
+		}
+
+		size_t GetNumPieceExtraEntries(size_t Offset) const
+		{
+			switch (RestartMode)
+			{
+			case EStripRestartMode::PositionW:
+				// A restart goes by the first of the ADC vertices, an extra one flips the winding of the piece
+				return Offset & 1;
+			default:
+				return (Entries.empty() ? 0 : 1) + GetNumFirstVertexCopies(Offset) - 1;
+			}
+		}
+
+		void WritePiece(const uint32_t* Piece, size_t Num, size_t Offset)
+		{
+			switch (RestartMode)
+			{
+			case EStripRestartMode::PositionW:
+				if (Offset & 1)
+				{
+					Entries.push_back({ Piece[0], true });
+				}
+				Entries.push_back({ Piece[0], true });
+				Entries.push_back({ Piece[1], true });
+				break;
+
+			default:
+			{
+				const size_t NumCopies = GetNumFirstVertexCopies(Offset);
+				if (!Entries.empty())
+				{
+					Entries.push_back(Entries.back());
+				}
+				for (size_t Copy = 0; Copy < NumCopies; ++Copy)
+				{
+					Entries.push_back({ Piece[0], false });
+				}
+				Entries.push_back({ Piece[1], false });
+				break;
+			}
+			}
+
+			for (size_t Index = 2; Index < Num; ++Index)
+			{
+				Entries.push_back({ Piece[Index], false });
+			}
+		}
+
+		std::vector<FStripEntry>& Entries;
+		EStripRestartMode RestartMode;
+		size_t BatchSize;
+	};
+}
+
+size_t PS2MeshCore::MaxStripIndices(size_t NumVertices)
+{
+	return NumVertices > 2 ? (NumVertices - 2) * 3 : 0;
+}
+
+size_t PS2MeshCore::DecodeStrips(const uint8_t* Positions, size_t Stride, size_t NumVertices, EStripRestartMode RestartMode, uint32_t* OutIndices, FStripDecodeStats* OutStats)
+{
+	FStripDecodeStats Stats;
+	size_t NumIndices = 0;
+
+	// First vertex of the strip currently being drawn, used to work out the winding
+	size_t StripStart = 0;
+	bool bPreviousADC = false;
+
+	for (size_t i = 0; i < NumVertices; ++i)
+	{
+		const bool bADC = IsADCSet(GetElement(Positions, Stride, i), RestartMode);
+
+		// A restart is two vertices in a row with ADC set, the first of those begins the new strip
+		if (bADC && !bPreviousADC)
+		{
+			StripStart = i;
+		}
+		bPreviousADC = bADC;
+
+		if (i < 2)
+		{
+			continue;
+		}
+
+		Stats.NumStripTriangles++;
+
+		if (bADC)
+		{
+			Stats.NumSkippedTriangles++;
+			continue;
+		}
+
+		uint32_t A = uint32_t(i - 2);
+		uint32_t B = uint32_t(i - 1);
+		const uint32_t C = uint32_t(i);
+		if (((i - StripStart) & 1) != 0)
+		{
+			std::swap(A, B);
+		}
+
+		if (IsDegenerate(GetElement(Positions, Stride, A), GetElement(Positions, Stride, B), GetElement(Positions, Stride, C)))
+		{
+			Stats.NumDegenerateTriangles++;
+			continue;
+		}
+
+		OutIndices[NumIndices++] = A;
+		OutIndices[NumIndices++] = B;
+		OutIndices[NumIndices++] = C;
+	}
+
+	if (OutStats)
+	{
+		*OutStats = Stats;
+	}
+	return NumIndices;
+}
+
+void PS2MeshCore::TransformPositions(const uint8_t* Source, size_t Stride, size_t Num, const float Matrix[4][4], float* OutPositions)
+{
+	// PS2 (x, y, z) is UE (x, z, y), so the file's Y row is the matrix's Z row and the other way around
+	float Rows[4][4];
+	LoadRow(Matrix, 0, 1.f, Rows[0]);
+	LoadRow(Matrix, 2, 1.f, Rows[1]);
+	LoadRow(Matrix, 1, 1.f, Rows[2]);
+	LoadRow(Matrix, 3, 1.f, Rows[3]);
+
+	TransformElements(Source, Stride, Num, Rows, OutPositions);
+}
+
+void PS2MeshCore::TransformNormals(const uint8_t* Source, size_t Stride, size_t Num, const float Matrix[4][4], float* OutNormals)
+{
+	// Normals also get their Z flipped after the basis swap, which negates the file's Y row
+	float Rows[4][4];
+	LoadRow(Matrix, 0, 1.f, Rows[0]);
+	LoadRow(Matrix, 2, -1.f, Rows[1]);
+	LoadRow(Matrix, 1, 1.f, Rows[2]);
+	LoadRow(Matrix, 3, 0.f, Rows[3]);
+
+	TransformElements(Source, Stride, Num, Rows, OutNormals);
+}
+
+PS2MeshCore::FColorLinearizer::FColorLinearizer(float InGamma)
+	: Gamma(InGamma)
+{
+	// One extra entry so the last step can interpolate up to MaxTableValue
+	Table.resize(NumTableSteps + 1);
+	for (int32_t Step = 0; Step <= NumTableSteps; ++Step)
+	{
+		Table[Step] = std::pow(MaxTableValue * Step / NumTableSteps, Gamma);
+	}
+}
+
+float PS2MeshCore::FColorLinearizer::Linearize(float Value) const
+{
+	// Written so NaNs also take the slow path
+	if (!(Value >= 0.f && Value < MaxTableValue))
+	{
+		return std::pow(Value, Gamma);
+	}
+
+	const float Position = Value * (NumTableSteps / MaxTableValue);
+	const int32_t Step = std::min(int32_t(Position), NumTableSteps - 1);
+	const float Alpha = Position - Step;
+	return Table[Step] + (Table[Step + 1] - Table[Step]) * Alpha;
+}
+
+void PS2MeshCore::FColorLinearizer::LinearizeColors(const uint8_t* Source, size_t Stride, size_t Num, bool bLinearizeAlpha, float* OutColors) const
+{
+	for (size_t Index = 0; Index < Num; ++Index)
+	{
+		const float* Color = GetElement(Source, Stride, Index);
+
+		float* OutColor = OutColors + Index * 4;
+		OutColor[0] = Linearize(Color[0]);
+		OutColor[1] = Linearize(Color[1]);
+		OutColor[2] = Linearize(Color[2]);
+		OutColor[3] = bLinearizeAlpha ? Linearize(Color[3]) : Color[3];
+	}
+}
+
+size_t PS2MeshCore::WeldVertices(void* Vertices, size_t NumVertices, size_t VertexSize, uint32_t* Indices, size_t NumIndices)
+{
+	std::vector<uint32_t> Remap(NumVertices);
+
+	const size_t NumUniqueVertices = meshopt_generateVertexRemap(Remap.data(), Indices, NumIndices, Vertices, NumVertices, VertexSize);
+	meshopt_remapIndexBuffer(Indices, Indices, NumIndices, Remap.data());
+
+	// Remapping in place is supported, meshoptimizer copies the source first
+	meshopt_remapVertexBuffer(Vertices, Vertices, NumVertices, VertexSize, Remap.data());
+	return NumUniqueVertices;
+}
+
+size_t PS2MeshCore::RemoveUnusedVertices(void* Vertices, size_t NumVertices, size_t VertexSize, uint32_t* Indices, size_t NumIndices)
+{
+	constexpr uint32_t Unused = ~0u;
+
+	std::vector<uint32_t> Remap(NumVertices, Unused);
+	for (size_t Index = 0; Index < NumIndices; ++Index)
+	{
+		Remap[Indices[Index]] = 0;
+	}
+
+	uint8_t* VertexBytes = static_cast<uint8_t*>(Vertices);
+	uint32_t NumUsedVertices = 0;
+	for (size_t VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		if (Remap[VertexIndex] != Unused)
+		{
+			if (NumUsedVertices != VertexIndex)
+			{
+				std::memcpy(VertexBytes + NumUsedVertices * VertexSize, VertexBytes + VertexIndex * VertexSize, VertexSize);
+			}
+			Remap[VertexIndex] = NumUsedVertices++;
+		}
+	}
+
+	for (size_t Index = 0; Index < NumIndices; ++Index)
+	{
+		Indices[Index] = Remap[Indices[Index]];
+	}
+	return NumUsedVertices;
+}
+
+size_t PS2MeshCore::SimplifyTriangles(const uint32_t* Indices, size_t NumIndices, const uint8_t* Positions, size_t Stride, size_t NumVertices, size_t TargetIndexCount, float MaxError, bool bLockBorder, uint32_t* OutIndices, float* OutError)
+{
+	const float* VertexPositions = reinterpret_cast<const float*>(Positions);
+
+	float RelativeError = 0.f;
+	const unsigned int SimplifyOptions = bLockBorder ? meshopt_SimplifyLockBorder : 0;
+	const size_t NumSimplifiedIndices = meshopt_simplify(OutIndices, Indices, NumIndices, VertexPositions, NumVertices, Stride, TargetIndexCount, MaxError, SimplifyOptions, &RelativeError);
+
+	if (OutError)
+	{
+		*OutError = RelativeError * meshopt_simplifyScale(VertexPositions, NumVertices, Stride);
+	}
+	return NumSimplifiedIndices;
+}
+
+void PS2MeshCore::BuildStrips(const uint32_t* Indices, size_t NumIndices, size_t NumVertices, EStripRestartMode RestartMode, size_t BatchSize, std::vector<FStripEntry>& OutEntries, FStripBuildStats* OutStats)
+{
+	constexpr uint32_t RestartIndex = ~0u;
+
+	if (BatchSize != 0)
+	{
+		BatchSize = std::max<size_t>(BatchSize & ~size_t(1), 8);
+	}
+
+	std::vector<uint32_t> Optimized(NumIndices);
+	meshopt_optimizeVertexCacheStrip(Optimized.data(), Indices, NumIndices, NumVertices);
+
+	std::vector<uint32_t> Strips(meshopt_stripifyBound(NumIndices));
+	Strips.resize(meshopt_stripify(Strips.data(), Optimized.data(), NumIndices, NumVertices, RestartIndex));
+
+	FStripBuildStats Stats;
+	OutEntries.clear();
+	OutEntries.reserve(Strips.size() + Strips.size() / 4);
+
+	FStripWriter Writer(OutEntries, RestartMode, BatchSize);
+	size_t StripStart = 0;
+	for (size_t Index = 0; Index <= Strips.size(); ++Index)
+	{
+		if (Index < Strips.size() && Strips[Index] != RestartIndex)
+		{
+			continue;
+		}
+
+		const size_t NumStripVertices = Index - StripStart;
+		if (NumStripVertices >= 3)
+		{
+			Writer.WriteStrip(Strips.data() + StripStart, NumStripVertices, Stats.NumExtraEntries);
+			Stats.NumStrips++;
+			Stats.NumStripTriangles += NumStripVertices - 2;
+			Stats.MaxStripTriangles = std::max(Stats.MaxStripTriangles, NumStripVertices - 2);
+		}
+		StripStart = Index + 1;
+	}
+
+	Stats.NumEntries = OutEntries.size();
+	Stats.NumBatches = BatchSize == 0 ? (OutEntries.empty() ? 0 : 1) : (OutEntries.size() + BatchSize - 1) / BatchSize;
+	if (OutStats)
+	{
+		*OutStats = Stats;
+	}
+}
+
+void PS2MeshCore::PadStripBatch(std::vector<FStripEntry>& Entries, size_t BatchSize)
+{
+	if (BatchSize != 0)
+	{
+		BatchSize = std::max<size_t>(BatchSize & ~size_t(1), 8);
+	}
+	FStripWriter(Entries, EStripRestartMode::None, BatchSize).PadBatch();
+}
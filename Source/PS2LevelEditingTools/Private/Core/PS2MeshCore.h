@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The data processing stages of a .mdl import, without any engine types so they can also be built and benchmarked as a
+ * plain C++ program (see Benchmarks/PS2MeshImport). The translator reaches these through the PS2StripDecoder,
+ * PS2VertexTransform and PS2VertexColor wrappers.
+ *
+ * Vertex arrays are passed as a pointer to the first element and a stride in bytes, as the file's arrays and the
+ * interleaved import vertices both hold more than the attribute being read.
+ */
+namespace PS2MeshCore
+{
+	/** Same values as EPS2StripRestartMode. */
+	enum class EStripRestartMode : uint8_t
+	{
+		None,
+		PositionW
+	};
+
+	struct FStripDecodeStats
+	{
+		// Triangles the strip would draw if every vertex kicked one
+		int32_t NumStripTriangles = 0;
+
+		// Triangles not drawn because their last vertex has ADC set
+		int32_t NumSkippedTriangles = 0;
+
+		// Triangles dropped because two of their corners are the same point or they have no area
+		int32_t NumDegenerateTriangles = 0;
+	};
+
+	/** Most indices DecodeStrips can write for a strip of NumVertices vertices. */
+	size_t MaxStripIndices(size_t NumVertices);
+
+	/**
+	 * Turns a strip into a triangle list, see DecodePS2Strips. Each position is four floats, the fourth holding the
+	 * ADC flag in PositionW mode.
+	 *
+	 * @param OutIndices	Room for MaxStripIndices(NumVertices) indices.
+	 * @return The number of indices written.
+	 */
+	size_t DecodeStrips(const uint8_t* Positions, size_t Stride, size_t NumVertices, EStripRestartMode RestartMode, uint32_t* OutIndices, FStripDecodeStats* OutStats = nullptr);
+
+	/**
+	 * Converts positions from the PS2 basis (Y up) to the UE basis and transforms them by a row major matrix that
+	 * multiplies row vectors, including translation. Each source element starts with three floats, each output is three
+	 * floats.
+	 */
+	void TransformPositions(const uint8_t* Source, size_t Stride, size_t Num, const float Matrix[4][4], float* OutPositions);
+
+	/** As TransformPositions for normals, which also have their Z flipped after the basis swap and ignore translation. */
+	void TransformNormals(const uint8_t* Source, size_t Stride, size_t Num, const float Matrix[4][4], float* OutNormals);
+
+	/**
+	 * Tabulated gamma curve for PS2 vertex colors. PS2 colors are scaled so 0x80 is full intensity, which makes values up
+	 * to 2 valid, so the curve is tabulated over [0, 2] and interpolated. Values outside of that range use std::pow.
+	 */
+	class FColorLinearizer
+	{
+	public:
+		explicit FColorLinearizer(float InGamma);
+
+		float Linearize(float Value) const;
+
+		/** Each source element starts with four floats (r, g, b, a), each output is four floats. */
+		void LinearizeColors(const uint8_t* Source, size_t Stride, size_t Num, bool bLinearizeAlpha, float* OutColors) const;
+
+		float GetGamma() const { return Gamma; }
+
+	private:
+		static constexpr float MaxTableValue = 2.f;
+		static constexpr int32_t NumTableSteps = 2048;
+
+		float Gamma;
+		std::vector<float> Table;
+	};
+
+	/**
+	 * Merges bytewise identical vertices and remaps the triangle list onto them. The welded vertices are written over
+	 * the start of Vertices in first use order.
+	 *
+	 * @return The number of vertices left.
+	 */
+	size_t WeldVertices(void* Vertices, size_t NumVertices, size_t VertexSize, uint32_t* Indices, size_t NumIndices);
+
+	/**
+	 * Removes the vertices no triangle uses, keeping the rest in order, and remaps the triangle list onto them.
+	 *
+	 * @return The number of vertices left.
+	 */
+	size_t RemoveUnusedVertices(void* Vertices, size_t NumVertices, size_t VertexSize, uint32_t* Indices, size_t NumIndices);
+
+	/**
+	 * Simplifies a triangle list towards TargetIndexCount indices with meshoptimizer, stopping early rather than go over
+	 * MaxError. Vertices that share a position but differ in any other attribute are seams and stay seams, so UV and
+	 * vertex color boundaries of a welded mesh keep their shape.
+	 *
+	 * @param Positions		Three floats per vertex at the start of each element.
+	 * @param MaxError		Largest error allowed, relative to the size of the mesh.
+	 * @param bLockBorder	Keep every vertex on an open border. Needed when the mesh is one section of a model, so the
+	 *						edges it shares with the other sections are simplified the same on both sides and don't crack.
+	 * @param OutIndices	Room for NumIndices indices.
+	 * @param OutError		The error of the result in the units of the positions.
+	 * @return The number of indices written.
+	 */
+	size_t SimplifyTriangles(const uint32_t* Indices, size_t NumIndices, const uint8_t* Positions, size_t Stride, size_t NumVertices, size_t TargetIndexCount, float MaxError, bool bLockBorder, uint32_t* OutIndices, float* OutError = nullptr);
+
+	/** One entry of a strip stream, the vertex it uses and whether its ADC flag is set. */
+	struct FStripEntry
+	{
+		uint32_t Vertex;
+		bool bADC;
+	};
+
+	struct FStripBuildStats
+	{
+		// Strips meshoptimizer made, before any were split at a batch boundary
+		size_t NumStrips = 0;
+		size_t NumStripTriangles = 0;
+		size_t MaxStripTriangles = 0;
+
+		size_t NumBatches = 0;
+		size_t NumEntries = 0;
+
+		// Entries that only stitch, restart, continue or pad strips and draw nothing
+		size_t NumExtraEntries = 0;
+	};
+
+	/**
+	 * Turns a triangle list into a strip stream DecodeStrips reads back as the same triangles, the reverse of a .mdl
+	 * import. Triangles are reordered for vertex cache and strip locality and stripified with meshoptimizer, then the
+	 * strips are joined the way RestartMode reads them: stitched with repeated vertices, or restarted with ADC.
+	 *
+	 * The stream is also split into batches of BatchSize entries, the vertices the runtime uploads to VU1 at once. Each
+	 * batch starts a new strip on the PS2, so no strip runs across a batch boundary. A strip that doesn't fit carries on
+	 * in the next batch from its last two vertices, and the end of a batch with no room left for a strip is padded.
+	 *
+	 * @param BatchSize		Entries per batch, rounded down to even and at least 8. 0 doesn't split the stream.
+	 * @param OutEntries	Receives the stream.
+	 */
+	void BuildStrips(const uint32_t* Indices, size_t NumIndices, size_t NumVertices, EStripRestartMode RestartMode, size_t BatchSize, std::vector<FStripEntry>& OutEntries, FStripBuildStats* OutStats = nullptr);
+
+	/** Pads a strip stream with degenerate entries up to the end of its last batch, so whatever follows starts a batch. */
+	void PadStripBatch(std::vector<FStripEntry>& Entries, size_t BatchSize);
+}
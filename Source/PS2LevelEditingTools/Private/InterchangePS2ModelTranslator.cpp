@@ -4,22 +4,30 @@
 #include "InterchangePS2ModelTranslator.h"
 #include "Async/Async.h"
 #include "Async/Future.h"
+#include "Async/ParallelFor.h"
 #include "StaticMeshAttributes.h"
 #include "StaticMeshOperations.h"
 #include "Misc/FileHelper.h"
 #include "MaterialDomain.h"
 #include "MaterialShared.h"
 #include "Materials/Material.h"
+#include "InterchangeSceneNode.h"
 #include "PS2LevelEditingDeveloperSettings.h"
-
-#include "meshoptimizer.h"
+#include "PS2LevelEditingStats.h"
+#include "PS2LevelEditingTools.h"
+#include "PS2MeshFile.h"
+#include "PS2MeshSections.h"
+#include "PS2MeshPayloadCache.h"
+#include "PS2StripDecoder.h"
+#include "PS2VertexColor.h"
+#include "PS2VertexTransform.h"
+#include "Core/PS2MeshCore.h"
 
 #include "egg/mesh_header.hpp"
 
 UInterchangePS2ModelTranslator::UInterchangePS2ModelTranslator(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
-	MeshHeader = nullptr;
 }
 
 TArray<FString> UInterchangePS2ModelTranslator::GetSupportedFormats() const
@@ -32,26 +40,37 @@ EInterchangeTranslatorAssetType UInterchangePS2ModelTranslator::GetSupportedAsse
 	return EInterchangeTranslatorAssetType::Meshes;
 }
 
-bool UInterchangePS2ModelTranslator::Translate(UInterchangeBaseNodeContainer& BaseNodeContainer) const
+// Generated LODs are payloads of their own, keyed on the file's key followed by this and the LOD index. LOD0 keeps the
+// file's key
+static const TCHAR* const LODPayloadKeySeparator = TEXT("|LOD");
+
+static FString MakeLODPayloadKey(const FString& FileKey, int32 LODIndex)
 {
-	FString Filename = GetSourceData()->GetFilename();
-	if (!FPaths::FileExists(Filename))
+	return LODIndex == 0 ? FileKey : FString::Printf(TEXT("%s%s%d"), *FileKey, LODPayloadKeySeparator, LODIndex);
+}
+
+static int32 GetLODIndex(const FString& PayloadKey)
+{
+	FString LODIndex;
+	if (PayloadKey.Split(LODPayloadKeySeparator, nullptr, &LODIndex, ESearchCase::CaseSensitive, ESearchDir::FromEnd))
 	{
-		return false;
+		return FCString::Atoi(*LODIndex);
 	}
+	return 0;
+}
 
-	FFileHelper::LoadFileToArray(const_cast<ThisClass*>(this)->MeshFile, *Filename);
-
-	const_cast<ThisClass*>(this)->MeshHeader = (MeshFileHeader*)MeshFile.GetData();
-
-	const FString GroupName = Filename;
-	const FString NodeUid = Filename;
+static int32 GetNumLODs(const UPS2LevelEditingDeveloperSettings& Settings)
+{
+	return Settings.bGenerateLODs ? 1 + Settings.LODTriangleRatios.Num() : 1;
+}
 
+static UInterchangeMeshNode* AddMeshNode(UInterchangeBaseNodeContainer& BaseNodeContainer, const FString& NodeUid, const FString& DisplayName)
+{
 	UInterchangeMeshNode* MeshNode = NewObject<UInterchangeMeshNode>(&BaseNodeContainer);
-	MeshNode->InitializeNode(NodeUid, GroupName, EInterchangeNodeContainerType::TranslatedAsset);
+	MeshNode->InitializeNode(NodeUid, DisplayName, EInterchangeNodeContainerType::TranslatedAsset);
 	BaseNodeContainer.AddNode(MeshNode);
 
-	MeshNode->SetPayLoadKey(GroupName, EInterchangeMeshPayLoadType::STATIC);
+	MeshNode->SetPayLoadKey(NodeUid, EInterchangeMeshPayLoadType::STATIC);
 
 	MeshNode->SetCustomHasVertexNormal(true);
 	MeshNode->SetCustomHasVertexBinormal(false);
@@ -59,207 +78,429 @@ bool UInterchangePS2ModelTranslator::Translate(UInterchangeBaseNodeContainer& Ba
 	MeshNode->SetCustomHasSmoothGroup(false);
 	MeshNode->SetCustomHasVertexColor(true);
 	MeshNode->SetCustomUVCount(1);
-	MeshNode->SetCustomPolygonCount(MeshHeader->pos.num_elements() - 2);
-	MeshNode->SetCustomVertexCount(MeshHeader->pos.num_elements());
+	return MeshNode;
+}
+
+static UInterchangeSceneNode* AddSceneNode(UInterchangeBaseNodeContainer& BaseNodeContainer, const FString& NodeUid, const FString& DisplayName, const FString& ParentUid)
+{
+	UInterchangeSceneNode* SceneNode = NewObject<UInterchangeSceneNode>(&BaseNodeContainer);
+	SceneNode->InitializeNode(NodeUid, DisplayName, EInterchangeNodeContainerType::TranslatedScene);
+	SceneNode->SetCustomLocalTransform(&BaseNodeContainer, FTransform::Identity);
+	BaseNodeContainer.AddNode(SceneNode);
+	if (!ParentUid.IsEmpty())
+	{
+		BaseNodeContainer.SetNodeParentUid(NodeUid, ParentUid);
+	}
+	return SceneNode;
+}
+
+bool UInterchangePS2ModelTranslator::Translate(UInterchangeBaseNodeContainer& BaseNodeContainer) const
+{
+	const TSharedRef<FPS2OperationReport, ESPMode::ThreadSafe> Report = FPS2OperationReport::GetImportReport();
+	PS2_SCOPE_PHASE(&Report.Get(), Translate);
+
+	FString Filename = GetSourceData()->GetFilename();
+	if (!FPaths::FileExists(Filename))
+	{
+		return false;
+	}
+
+	const FPS2MeshFilePtr MeshFile = GetMeshFile();
+	if (!MeshFile.IsValid())
+	{
+		return false;
+	}
+	PS2_ADD_COUNTER(&Report.Get(), BytesRead, MeshFile->GetSize());
+
+	const MeshFileHeader* MeshHeader = &MeshFile->GetHeader();
+
+	TArray<FPS2MeshSection> Sections;
+	LoadPS2MeshSections(*MeshFile, FName(UPS2LevelEditingDeveloperSettings::Get()->ModelMaterial.GetAssetName()), Sections);
+
+	// Decode the strips here as well so the reported counts match what the payload will contain
+	int32 NumTriangles = 0;
+	int32 NumVertices = 0;
+	TArray<uint32> Indices;
+	for (const FPS2MeshSection& Section : Sections)
+	{
+		DecodePS2Strips(*MeshHeader, Section.FirstVertex, Section.NumVertices, UPS2LevelEditingDeveloperSettings::Get()->StripRestartMode, Indices);
+		NumTriangles += Indices.Num() / 3;
+		NumVertices += Section.NumVertices;
+	}
+
+	UInterchangeMeshNode* MeshNode = AddMeshNode(BaseNodeContainer, Filename, Filename);
+	MeshNode->SetCustomPolygonCount(NumTriangles);
+	MeshNode->SetCustomVertexCount(NumVertices);
+
+	// Generated LODs are put under a LOD group, which is how the mesh pipeline finds out they're LODs of one mesh
+	const int32 NumLODs = GetNumLODs(*UPS2LevelEditingDeveloperSettings::Get());
+	if (NumLODs > 1)
+	{
+		const FString LODGroupUid = Filename + TEXT("|LODGroup");
+		UInterchangeSceneNode* LODGroupNode = AddSceneNode(BaseNodeContainer, LODGroupUid, FPaths::GetBaseFilename(Filename), FString());
+		LODGroupNode->AddSpecializedType(UE::Interchange::FSceneNodeStaticData::GetLodGroupSpecializeTypeString());
+
+		for (int32 LODIndex = 0; LODIndex < NumLODs; ++LODIndex)
+		{
+			const FString LODKey = MakeLODPayloadKey(Filename, LODIndex);
+			if (LODIndex > 0)
+			{
+				AddMeshNode(BaseNodeContainer, LODKey, LODKey);
+			}
+
+			UInterchangeSceneNode* LODNode = AddSceneNode(BaseNodeContainer, LODGroupUid + FString::Printf(TEXT("%d"), LODIndex), FString::Printf(TEXT("LOD%d"), LODIndex), LODGroupUid);
+			LODNode->SetCustomAssetInstanceUid(LODKey);
+		}
+	}
 
 	return true;
 }
 
-static FVector3f PositionToUEBasis(const Vector& InVector)
+void UInterchangePS2ModelTranslator::ReleaseSource()
 {
-	return FVector3f(InVector.x, InVector.z, InVector.y);
+	FScopeLock Lock(&MeshFileLock);
+	MeshFile.Reset();
 }
 
-TFuture<TOptional<UE::Interchange::FMeshPayloadData>> UInterchangePS2ModelTranslator::GetMeshPayloadData(const FInterchangeMeshPayLoadKey& PayLoadKey, const FTransform& MeshGlobalTransform) const
+FPS2MeshFilePtr UInterchangePS2ModelTranslator::GetMeshFile() const
+{
+	FScopeLock Lock(&MeshFileLock);
+	if (!MeshFile.IsValid())
+	{
+		MeshFile = FPS2MeshFile::Open(GetSourceData()->GetFilename());
+	}
+	return MeshFile;
+}
+
+// Settings a payload is built with, read from the developer settings on the thread requesting the payload
+struct FPS2MeshBuildSettings
+{
+	bool bWeldVertices = true;
+	EPS2StripRestartMode StripRestartMode = EPS2StripRestartMode::None;
+	FString MaterialName;
+	TSharedPtr<const FPS2VertexColorLinearizer, ESPMode::ThreadSafe> ColorLinearizer;
+	bool bLinearizeVertexAlpha = true;
+	bool bCachePayloads = true;
+	TArray<float> LODTriangleRatios;
+	float LODMaxError = 0.f;
+
+	// Everything above that changes the built mesh description, for the payload cache key
+	FString GetCacheKey() const
+	{
+		return FString::Printf(TEXT("%d_%d_%s_%g_%d"), bWeldVertices, int32(StripRestartMode), *MaterialName, ColorLinearizer->GetGamma(), bLinearizeVertexAlpha);
+	}
+
+	static FPS2MeshBuildSettings FromDeveloperSettings()
+	{
+		const UPS2LevelEditingDeveloperSettings* DeveloperSettings = UPS2LevelEditingDeveloperSettings::Get();
+
+		FPS2MeshBuildSettings Settings;
+		Settings.bWeldVertices = DeveloperSettings->bWeldVertices;
+		Settings.StripRestartMode = DeveloperSettings->StripRestartMode;
+		Settings.MaterialName = DeveloperSettings->ModelMaterial.GetAssetName();
+		Settings.ColorLinearizer = FPS2VertexColorLinearizer::Get(DeveloperSettings->VertexColorGamma);
+		Settings.bLinearizeVertexAlpha = DeveloperSettings->bLinearizeVertexAlpha;
+		Settings.bCachePayloads = DeveloperSettings->bCachePayloads;
+		Settings.LODTriangleRatios = DeveloperSettings->LODTriangleRatios;
+		Settings.LODMaxError = DeveloperSettings->LODMaxError;
+		return Settings;
+	}
+};
+
+// A single strip entry. Vertices are compared bytewise when welding so these must be zero initialized
+struct FPS2Vertex
+{
+	Vector pos;
+	Vector nrm;
+	Vector2 uvs;
+	Vector colors;
+};
+
+// Merges identical vertices and remaps the triangle list onto them
+static void WeldVertices(TArray<FPS2Vertex>& Vertices, TArray<uint32>& Indices)
+{
+	const size_t NumUniqueVertices = PS2MeshCore::WeldVertices(Vertices.GetData(), Vertices.Num(), sizeof(FPS2Vertex), Indices.GetData(), Indices.Num());
+	Vertices.SetNum(NumUniqueVertices);
+}
+
+// Removes the vertices only used by dropped strip triangles, keeping the rest in order
+static void RemoveUnusedVertices(TArray<FPS2Vertex>& Vertices, TArray<uint32>& Indices)
+{
+	const size_t NumUsedVertices = PS2MeshCore::RemoveUnusedVertices(Vertices.GetData(), Vertices.Num(), sizeof(FPS2Vertex), Indices.GetData(), Indices.Num());
+	Vertices.SetNum(NumUsedVertices);
+}
+
+// Fills a MeshDescription from a welded vertex array and triangle list. Every element is reserved up front and the
+// attributes are written through their raw arrays in contiguous passes rather than one vertex instance at a time
+static void BuildMeshDescription(FMeshDescription& MeshDescription, const TArray<FPS2Vertex>& Vertices, const TArray<uint32>& Indices, const FTransform& MeshGlobalTransform, FName MaterialSlotName, const FPS2MeshBuildSettings& Settings)
+{
+	const int32 NumVertices = Vertices.Num();
+	const int32 NumVertexInstances = Indices.Num();
+	const int32 NumTriangles = Indices.Num() / 3;
+
+	FStaticMeshAttributes Attributes(MeshDescription);
+	Attributes.Register();
+
+	MeshDescription.SuspendVertexInstanceIndexing();
+	MeshDescription.SuspendEdgeIndexing();
+	MeshDescription.SuspendPolygonIndexing();
+	MeshDescription.SuspendPolygonGroupIndexing();
+	MeshDescription.SuspendUVIndexing();
+
+	MeshDescription.SetNumUVChannels(1);
+	MeshDescription.ReserveNewVertices(NumVertices);
+	MeshDescription.ReserveNewUVs(NumVertices);
+	MeshDescription.ReserveNewVertexInstances(NumVertexInstances);
+	MeshDescription.ReserveNewTriangles(NumTriangles);
+	MeshDescription.ReserveNewPolygons(NumTriangles);
+	MeshDescription.ReserveNewEdges(NumVertices + NumTriangles);
+
+	// Vertices and UVs. The description is empty so the IDs come out as 0..NumVertices-1
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		MeshDescription.CreateVertex();
+		MeshDescription.CreateUV(0);
+	}
+
+	TArrayView<FVector3f> Positions = Attributes.GetVertexPositions().GetRawArray();
+	PS2VertexTransform::TransformPositions(reinterpret_cast<const uint8*>(Vertices.GetData()) + STRUCT_OFFSET(FPS2Vertex, pos), sizeof(FPS2Vertex), NumVertices,
+		FMatrix44f(MeshGlobalTransform.ToMatrixWithScale()), Positions.GetData());
+
+	TArrayView<FVector2f> UVCoordinates = Attributes.GetUVCoordinates(0).GetRawArray();
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		UVCoordinates[VertexIndex] = FVector2f(Vertices[VertexIndex].uvs.x, Vertices[VertexIndex].uvs.y);
+	}
+
+	// Normals are shared by every instance of a vertex so only convert them once
+	TArray<FVector3f> VertexNormals;
+	VertexNormals.SetNumUninitialized(NumVertices);
+	PS2VertexTransform::TransformNormals(reinterpret_cast<const uint8*>(Vertices.GetData()) + STRUCT_OFFSET(FPS2Vertex, nrm), sizeof(FPS2Vertex), NumVertices,
+		FMatrix44f(MeshGlobalTransform.ToMatrixNoScale()), VertexNormals.GetData());
+
+	// Same for colors, which would otherwise take four pows for every triangle corner
+	TArray<FVector4f> VertexColors;
+	VertexColors.SetNumUninitialized(NumVertices);
+	Settings.ColorLinearizer->LinearizeColors(reinterpret_cast<const uint8*>(Vertices.GetData()) + STRUCT_OFFSET(FPS2Vertex, colors), sizeof(FPS2Vertex), NumVertices,
+		Settings.bLinearizeVertexAlpha, VertexColors.GetData());
+
+	// Vertex instances, one per triangle corner
+	TArray<FVertexInstanceID> VertexInstanceIDs;
+	VertexInstanceIDs.SetNumUninitialized(NumVertexInstances);
+	for (int32 Corner = 0; Corner < NumVertexInstances; ++Corner)
+	{
+		VertexInstanceIDs[Corner] = MeshDescription.CreateVertexInstance(FVertexID(Indices[Corner]));
+	}
+
+	TArrayView<FVector3f> InstanceNormals = Attributes.GetVertexInstanceNormals().GetRawArray();
+	TArrayView<FVector4f> InstanceColors = Attributes.GetVertexInstanceColors().GetRawArray();
+	TArrayView<FVector2f> InstanceUVs = Attributes.GetVertexInstanceUVs().GetRawArray(0);
+	for (int32 Corner = 0; Corner < NumVertexInstances; ++Corner)
+	{
+		const int32 InstanceIndex = VertexInstanceIDs[Corner];
+		const uint32 VertexIndex = Indices[Corner];
+
+		InstanceNormals[InstanceIndex] = VertexNormals[VertexIndex];
+		InstanceColors[InstanceIndex] = VertexColors[VertexIndex];
+		InstanceUVs[InstanceIndex] = UVCoordinates[VertexIndex];
+	}
+
+	FPolygonGroupID PolygonGroupIndex = MeshDescription.CreatePolygonGroup();
+	ensure(!MaterialSlotName.IsNone());
+
+	Attributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupIndex] = MaterialSlotName;
+
+	// Triangles go straight in, CreatePolygon would have to work out a triangulation for each of them
+	for (int32 TriangleIndex = 0; TriangleIndex < NumTriangles; ++TriangleIndex)
+	{
+		MeshDescription.CreateTriangle(PolygonGroupIndex, MakeArrayView(VertexInstanceIDs.GetData() + TriangleIndex * 3, 3));
+	}
+
+	MeshDescription.ResumeEdgeIndexing();
+
+	// Every edge is soft
+	TArrayView<bool> EdgeHardnesses = Attributes.GetEdgeHardnesses().GetRawArray();
+	for (bool& bHard : EdgeHardnesses)
+	{
+		bHard = false;
+	}
+
+	MeshDescription.ResumeVertexInstanceIndexing();
+	MeshDescription.ResumePolygonIndexing();
+	MeshDescription.ResumePolygonGroupIndexing();
+	MeshDescription.ResumeUVIndexing();
+}
+
+// Simplifies a welded section down to the triangle ratio of a generated LOD, then drops the vertices left unused. The
+// border is locked for models with several sections, as each section is simplified on its own
+static void SimplifyLOD(TArray<FPS2Vertex>& Vertices, TArray<uint32>& Indices, float TriangleRatio, float MaxError, bool bLockBorder, float& OutError)
 {
-	return Async(EAsyncExecution::TaskGraph, [this, PayLoadKey, MeshGlobalTransform]
+	const int32 TargetIndexCount = FMath::RoundToInt32(Indices.Num() / 3 * FMath::Clamp(TriangleRatio, 0.f, 1.f)) * 3;
+
+	TArray<uint32> LODIndices;
+	LODIndices.SetNumUninitialized(Indices.Num());
+	const size_t NumLODIndices = PS2MeshCore::SimplifyTriangles(Indices.GetData(), Indices.Num(), reinterpret_cast<const uint8*>(Vertices.GetData()) + STRUCT_OFFSET(FPS2Vertex, pos), sizeof(FPS2Vertex), Vertices.Num(),
+		TargetIndexCount, MaxError, bLockBorder, LODIndices.GetData(), &OutError);
+	LODIndices.SetNum(NumLODIndices, false);
+
+	Indices = MoveTemp(LODIndices);
+	RemoveUnusedVertices(Vertices, Indices);
+}
+
+// Builds the mesh description of one section of a LOD, or loads it from the payload cache. OutLODError is the
+// simplification error in model units, 0 for LOD0
+static void BuildSectionMeshDescription(FMeshDescription& MeshDescription, const FPS2MeshFile& MeshFile, const FPS2MeshSection& Section, bool bSingleSection, int32 LODIndex, const FString& SectionKey,
+	const FTransform& MeshGlobalTransform, const FPS2MeshBuildSettings& Settings, FPS2OperationReport& Report, float& OutLODError)
+{
+	OutLODError = 0.f;
+
+	const MeshFileHeader* MeshHeader = &MeshFile.GetHeader();
+
+	FString CacheKey;
+	if (Settings.bCachePayloads)
+	{
+		FString SectionCacheKey = FString::Printf(TEXT("%s_%d_%d_%s"), *Settings.GetCacheKey(), Section.FirstVertex, Section.NumVertices, *Section.MaterialSlotName.ToString());
+		if (LODIndex > 0)
 		{
-			using namespace UE::Interchange;
+			SectionCacheKey += FString::Printf(TEXT("_LOD%d_%g_%g"), LODIndex, Settings.LODTriangleRatios[LODIndex - 1], Settings.LODMaxError);
+		}
+		CacheKey = FPS2MeshPayloadCache::MakeKey(MeshFile, MeshGlobalTransform, SectionCacheKey);
+		if (FPS2MeshPayloadCache::Load(CacheKey, MeshDescription, OutLODError))
+		{
+			PS2_ADD_COUNTER(&Report, PayloadCacheHits, 1);
+			UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Loaded %s from the payload cache"), *SectionKey);
+			return;
+		}
+	}
 
-			check(MeshHeader != nullptr);
+	// Interleave the strip entries so identical vertices can be found and welded
+	TArray<FPS2Vertex> Vertices;
+	Vertices.SetNumZeroed(Section.NumVertices);
+	for (int32 i = 0; i < Section.NumVertices; ++i)
+	{
+		const size_t FileIndex = size_t(Section.FirstVertex) + i;
+		FPS2Vertex& NewVertex = Vertices[i];
+		NewVertex.pos = MeshHeader->pos[FileIndex];
+		NewVertex.nrm = MeshHeader->nrm[FileIndex];
+		NewVertex.uvs = MeshHeader->uvs[FileIndex];
+		NewVertex.colors = MeshHeader->colors[FileIndex];
+	}
 
-			FMeshPayloadData Payload;
+	TArray<uint32> OutputIndicies;
+	FPS2StripDecodeStats DecodeStats;
+	{
+		PS2_SCOPE_PHASE(&Report, DecodeStrips);
+		DecodePS2Strips(*MeshHeader, Section.FirstVertex, Section.NumVertices, Settings.StripRestartMode, OutputIndicies, &DecodeStats);
+	}
+	PS2_ADD_COUNTER(&Report, VerticesIn, Vertices.Num());
+	PS2_ADD_COUNTER(&Report, TrianglesIn, DecodeStats.NumStripTriangles);
+	PS2_ADD_COUNTER(&Report, DegeneratesDropped, DecodeStats.NumDegenerateTriangles);
 
-			TArray<uint32> OutputIndicies;
-			{
-				// Unstrippify
-				TArray<uint32> InputIndicies;
-				InputIndicies.SetNum(MeshHeader->pos.num_elements());
-				for (size_t i = 0; i < MeshHeader->pos.num_elements(); ++i)
-				{
-					InputIndicies[i] = i;
-				}
-				OutputIndicies.SetNumZeroed(meshopt_unstripifyBound(MeshHeader->pos.num_elements()));
-				OutputIndicies.SetNum(meshopt_unstripify(OutputIndicies.GetData(), InputIndicies.GetData(), InputIndicies.Num(), 0));
-
-				// Remap indices
-				//TArray<uint32> Remap;
-				//Remap.SetNum(OutputIndicies.Num());
-
-				//struct Vertex
-				//{
-				//	Vector pos;
-				//	Vector nrm;
-				//	Vector2 uvs;
-				//	Vector colors;
-				//};
-
-				//TArray<Vertex> Vertices;
-				//Vertices.SetNumZeroed(MeshHeader->pos.num_elements());
-				//for (size_t i = 0; i < MeshHeader->pos.num_elements(); ++i)
-				//{
-				//	Vertex& NewVertex = Vertices[i];
-				//	NewVertex.pos = MeshHeader->pos[i];
-				//	NewVertex.nrm = MeshHeader->nrm[i];
-				//	NewVertex.uvs = MeshHeader->uvs[i];
-				//	NewVertex.colors = MeshHeader->colors[i];
-				//}
-
-				//size_t total_vertices = meshopt_generateVertexRemap(Remap.GetData(), OutputIndicies.GetData(), OutputIndicies.Num(), Vertices.GetData(), Vertices.Num(), sizeof(Vertex));
-
-				//OutputIndicies.SetNum(total_indices);
-				//meshopt_remapIndexBuffer(&result.indices[0], NULL, total_indices, &remap[0]);
-
-				//result.vertices.resize(total_vertices);
-				//meshopt_remapVertexBuffer(&result.vertices[0], &vertices[0], total_indices, sizeof(Vertex), &remap[0]);
-			}
+	UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Decoded %s: %d strip triangles, %d skipped, %d degenerate, %d kept"),
+		*SectionKey, DecodeStats.NumStripTriangles, DecodeStats.NumSkippedTriangles, DecodeStats.NumDegenerateTriangles, OutputIndicies.Num() / 3);
 
+	if (Settings.bWeldVertices)
+	{
+		PS2_SCOPE_PHASE(&Report, WeldVertices);
+		const int32 NumStripVertices = Vertices.Num();
 
+		WeldVertices(Vertices, OutputIndicies);
 
-			FMeshDescription& MeshDescription = Payload.MeshDescription;
-			FStaticMeshAttributes Attributes(MeshDescription);
-			Attributes.Register();
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Welded %s: %d -> %d vertices"), *SectionKey, NumStripVertices, Vertices.Num());
+	}
+	else
+	{
+		RemoveUnusedVertices(Vertices, OutputIndicies);
+	}
 
-			MeshDescription.SuspendVertexInstanceIndexing();
-			MeshDescription.SuspendEdgeIndexing();
-			MeshDescription.SuspendPolygonIndexing();
-			MeshDescription.SuspendPolygonGroupIndexing();
-			MeshDescription.SuspendUVIndexing();
+	if (LODIndex > 0)
+	{
+		PS2_SCOPE_PHASE(&Report, SimplifyLOD);
+		SimplifyLOD(Vertices, OutputIndicies, Settings.LODTriangleRatios[LODIndex - 1], Settings.LODMaxError, !bSingleSection, OutLODError);
+	}
 
-			auto TransformPosition = [](const FMatrix& Matrix, FVector3f& Position)
-			{
-				const FVector TransformedPosition = Matrix.TransformPosition(FVector(Position));
-				Position = static_cast<FVector3f>(TransformedPosition);
-			};
-			
-			TVertexAttributesRef<FVector3f> MeshPositions = Attributes.GetVertexPositions();
-			MeshDescription.ReserveNewVertices(MeshHeader->pos.num_elements());
-			for (Vector pos : MeshHeader->pos)
-			{
-				FVertexID VertexIndex = MeshDescription.CreateVertex();
-				if (MeshPositions.GetRawArray().IsValidIndex(VertexIndex))
-				{
-					FVector3f& Position = Attributes.GetVertexPositions()[VertexIndex];
-					Position = PositionToUEBasis(pos);
+	PS2_ADD_COUNTER(&Report, VerticesOut, Vertices.Num());
+	PS2_ADD_COUNTER(&Report, TrianglesOut, OutputIndicies.Num() / 3);
 
-					TransformPosition(MeshGlobalTransform.ToMatrixWithScale(), Position);
-				}
-			}
+	{
+		PS2_SCOPE_PHASE(&Report, BuildMeshDescription);
+		BuildMeshDescription(MeshDescription, Vertices, OutputIndicies, MeshGlobalTransform, Section.MaterialSlotName, Settings);
+	}
 
-			// Create UVs and initialize values
-			MeshDescription.SetNumUVChannels(1);
-			MeshDescription.ReserveNewUVs(1);
-			for (Vector2 uv : MeshHeader->uvs)
-			{
-				FUVID UVIndex = MeshDescription.CreateUV(0);
-				Attributes.GetUVCoordinates(0)[UVIndex].X = uv.x;
-				Attributes.GetUVCoordinates(0)[UVIndex].Y = uv.y;
-			}
+	if (Settings.bCachePayloads)
+	{
+		FPS2MeshPayloadCache::Store(CacheKey, MeshDescription, OutLODError);
+	}
+}
 
-			FPolygonGroupID PolygonGroupIndex = MeshDescription.CreatePolygonGroup();
-			const FString MaterialName = UPS2LevelEditingDeveloperSettings::Get()->ModelMaterial.GetAssetName();
-			ensure(!MaterialName.IsEmpty());
+TFuture<TOptional<UE::Interchange::FMeshPayloadData>> UInterchangePS2ModelTranslator::GetMeshPayloadData(const FInterchangeMeshPayLoadKey& PayLoadKey, const FTransform& MeshGlobalTransform) const
+{
+	// Everything the task needs is captured by value so payloads for any number of files can build at the same time
+	const FPS2MeshFilePtr MeshFile = GetMeshFile();
+	const FPS2MeshBuildSettings Settings = FPS2MeshBuildSettings::FromDeveloperSettings();
+	const TSharedRef<FPS2OperationReport, ESPMode::ThreadSafe> Report = FPS2OperationReport::GetImportReport();
 
-			Attributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupIndex] = FName(MaterialName);
+	return Async(EAsyncExecution::TaskGraph, [MeshFile, Settings, Report, PayLoadKey, MeshGlobalTransform]
+		{
+			using namespace UE::Interchange;
 
-			MeshDescription.ReserveNewTriangles(MeshHeader->pos.num_elements() - 2);
-			MeshDescription.ReserveNewPolygons(MeshHeader->pos.num_elements() - 2);
+			PS2_SCOPE_PHASE(&Report.Get(), GetMeshPayloadData);
 
-			TArray<FVertexInstanceID, TInlineAllocator<3>> VertexInstanceIDs;
-			for (int32 TriangleIndex = 0; TriangleIndex < (OutputIndicies.Num() / 3); ++TriangleIndex)
+			const int32 LODIndex = GetLODIndex(PayLoadKey.UniqueId);
+			if (!MeshFile.IsValid() || LODIndex < 0 || LODIndex > Settings.LODTriangleRatios.Num())
 			{
-				VertexInstanceIDs.Reset();
-				MeshDescription.ReserveNewVertexInstances(3);
+				return TOptional<FMeshPayloadData>();
+			}
+
+			TArray<FPS2MeshSection> Sections;
+			LoadPS2MeshSections(*MeshFile, FName(Settings.MaterialName), Sections);
 
-				for (int i = TriangleIndex * 3; i < ((TriangleIndex * 3) + 3); ++i)
+			// Each section is built and cached on its own, so a big model spreads over the workers and changing one
+			// section's material leaves the others' cache entries in place
+			TArray<FMeshDescription> SectionDescriptions;
+			TArray<float> SectionLODErrors;
+			SectionDescriptions.SetNum(Sections.Num());
+			SectionLODErrors.SetNumZeroed(Sections.Num());
+			ParallelFor(Sections.Num(), [&](int32 SectionIndex)
 				{
-					FVertexID VertexID = OutputIndicies[i];
-					FVertexInstanceID VertexInstanceID = MeshDescription.CreateVertexInstance(VertexID);
-					VertexInstanceIDs.Add(VertexInstanceID);
-
-					check(Attributes.GetVertexInstanceNormals().IsValid() && Attributes.GetVertexInstanceNormals().GetNumChannels() > 0);
-
-					FVector3f& Normal = Attributes.GetVertexInstanceNormals()[VertexInstanceID];
-					Normal = PositionToUEBasis(MeshHeader->nrm[VertexID]);
-					Normal.Z *= -1.f;
-					TransformPosition(MeshGlobalTransform.ToMatrixNoScale(), Normal);
-
-					FVector4f& Color = Attributes.GetVertexInstanceColors()[VertexInstanceID];
-					Color.X = FMath::Pow(MeshHeader->colors[VertexID].x, 2.2);
-					Color.Y = FMath::Pow(MeshHeader->colors[VertexID].y, 2.2);
-					Color.Z = FMath::Pow(MeshHeader->colors[VertexID].z, 2.2);
-					Color.W = FMath::Pow(MeshHeader->colors[VertexID].w, 2.2);
-
-					FVector2f& UVs = Attributes.GetVertexInstanceUVs()[VertexInstanceID];
-					UVs.X = MeshHeader->uvs[VertexID].x;
-					UVs.Y = MeshHeader->uvs[VertexID].y;
+					const FString SectionKey = Sections.Num() > 1 ? FString::Printf(TEXT("%s#%d"), *PayLoadKey.UniqueId, SectionIndex) : PayLoadKey.UniqueId;
+					BuildSectionMeshDescription(SectionDescriptions[SectionIndex], *MeshFile, Sections[SectionIndex], Sections.Num() == 1, LODIndex, SectionKey, MeshGlobalTransform, Settings, Report.Get(), SectionLODErrors[SectionIndex]);
 				}
+			);
 
-				MeshDescription.CreatePolygon(PolygonGroupIndex, VertexInstanceIDs);
+			if (LODIndex > 0)
+			{
+				int32 NumLODTriangles = 0;
+				for (const FMeshDescription& SectionDescription : SectionDescriptions)
+				{
+					NumLODTriangles += SectionDescription.Triangles().Num();
+				}
+				const float LODError = FMath::Max(SectionLODErrors);
+				UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Simplified %s to %d triangles, error %f units"), *PayLoadKey.UniqueId, NumLODTriangles, LODError);
+				Report->SetDetail(PayLoadKey.UniqueId + TEXT(" Error"), FString::Printf(TEXT("%f"), LODError));
 			}
 
-			MeshDescription.ResumeEdgeIndexing();
-
-			for (const FEdgeID& EdgeID : MeshDescription.Edges().GetElementIDs())
+			FMeshPayloadData Payload;
+			if (SectionDescriptions.Num() == 1)
 			{
-				// Don't look at internal edges (edges within a polygon which break it into triangles)
-				if (!MeshDescription.IsEdgeInternal(EdgeID))
-				{
-					Attributes.GetEdgeHardnesses()[EdgeID] = false;
-
-					//bool bAllNormalsEqual = true;
-					//TArray<FPolygonID, TInlineAllocator<2>> EdgePolygonIDs = MeshDescription.GetEdgeConnectedPolygons<TInlineAllocator<2>>(EdgeID);
-
-					//for (const FVertexID& EdgeVertexID : MeshDescription.GetEdgeVertices(EdgeID))
-					//{
-					//	if (bAllNormalsEqual)
-					//	{
-					//		// This is the vertex index as it appears in the .obj
-					//		int32 ObjVertexIndex = OutputIndicies[EdgeVertexID];
-
-					//		// For the vertex we are considering, look at the first face adjacent to the edge, and find the vertex data which includes it
-					//		// This is a baseline we will use to compare all the other adjacent faces
-					//		const FVertexData& VertexData = Polygons[EdgePolygonIDs[0]]->GetVertexDataContainingVertexIndex(ObjVertexIndex);
-
-					//		for (int32 Index = 1; Index < EdgePolygonIDs.Num(); Index++)
-					//		{
-					//			// For all other adjacent faces, find the vertex data which includes the vertex we are considering.
-					//			// If the normal index is not the same as the baseline, we know this must be a hard edge.
-					//			const FVertexData& VertexDataToCompare = Polygons[EdgePolygonIDs[Index]]->GetVertexDataContainingVertexIndex(ObjVertexIndex);
-
-					//			if (VertexData.NormalIndex != VertexDataToCompare.NormalIndex)
-					//			{
-					//				bAllNormalsEqual = false;
-					//				break;
-					//			}
-					//		}
-					//	}
-					//}
-
-					//if (!bAllNormalsEqual)
-					//{
-					//	Attributes.GetEdgeHardnesses()[EdgeID] = false;
-					//}
+				Payload.MeshDescription = MoveTemp(SectionDescriptions[0]);
+			}
+			else
+			{
+				// Appending matches polygon groups by material slot, sections sharing a material end up in one group
+				FStaticMeshAttributes(Payload.MeshDescription).Register();
 
+				TArray<const FMeshDescription*> SourceDescriptions;
+				for (const FMeshDescription& SectionDescription : SectionDescriptions)
+				{
+					SourceDescriptions.Add(&SectionDescription);
 				}
-			}
 
-			MeshDescription.ResumeVertexInstanceIndexing();
-			MeshDescription.ResumePolygonIndexing();
-			MeshDescription.ResumePolygonGroupIndexing();
-			MeshDescription.ResumeUVIndexing();
+				FStaticMeshOperations::FAppendSettings AppendSettings;
+				FStaticMeshOperations::AppendMeshDescriptions(SourceDescriptions, Payload.MeshDescription, AppendSettings);
+			}
 
-			return TOptional<FMeshPayloadData>(Payload);
+			return TOptional<FMeshPayloadData>(MoveTemp(Payload));
 		}
 	);
 }
@@ -0,0 +1,173 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2ActorExportCache.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingTools/PS2StaticMeshComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Editor.h"
+#include "Subsystems/ImportSubsystem.h"
+#include "UObject/ObjectKey.h"
+
+namespace PS2ActorExportCache
+{
+	static TMap<TObjectKey<AActor>, FPS2ActorExportDataPtr> Actors;
+
+	static FDelegateHandle ActorMovedHandle;
+	static FDelegateHandle ObjectModifiedHandle;
+	static FDelegateHandle PropertyChangedHandle;
+	static FDelegateHandle UndoRedoHandle;
+	static FDelegateHandle MapOpenedHandle;
+	static FDelegateHandle ReimportHandle;
+	static FDelegateHandle SettingsChangedHandle;
+
+	static void InvalidateOwner(UObject* Object)
+	{
+		if (const AActor* Actor = Cast<AActor>(Object))
+		{
+			FPS2ActorExportCache::Invalidate(Actor);
+		}
+		else if (const UActorComponent* Component = Cast<UActorComponent>(Object))
+		{
+			FPS2ActorExportCache::Invalidate(Component->GetOwner());
+		}
+	}
+}
+
+uint32 FPS2ActorExportCache::ComputeFingerprint(const AActor* Actor)
+{
+	TArray<const UStaticMeshComponent*> Meshes;
+	Actor->GetComponents(Meshes);
+
+	uint32 Fingerprint = GetTypeHash(Meshes.Num());
+	for (const UStaticMeshComponent* Mesh : Meshes)
+	{
+		const FMatrix Transform = Mesh->GetComponentTransform().ToMatrixWithScale();
+		Fingerprint = HashCombine(Fingerprint, GetTypeHash(Mesh));
+		Fingerprint = HashCombine(Fingerprint, GetTypeHash(Mesh->GetStaticMesh()));
+		Fingerprint = FCrc::MemCrc32(&Transform.M[0][0], sizeof(Transform.M), Fingerprint);
+
+		if (const UInstancedStaticMeshComponent* InstancedMesh = Cast<UInstancedStaticMeshComponent>(Mesh))
+		{
+			// Instances can be moved without their component broadcasting a modify, so their transforms are hashed too
+			Fingerprint = HashCombine(Fingerprint, GetTypeHash(InstancedMesh->PerInstanceSMData.Num()));
+			Fingerprint = FCrc::MemCrc32(InstancedMesh->PerInstanceSMData.GetData(), InstancedMesh->PerInstanceSMData.Num() * sizeof(FInstancedStaticMeshInstanceData), Fingerprint);
+		}
+		if (const UPS2StaticMeshComponent* PS2Component = Cast<UPS2StaticMeshComponent>(Mesh))
+		{
+			Fingerprint = HashCombine(Fingerprint, GetTypeHash(PS2Component->AssetPath));
+		}
+	}
+	return Fingerprint;
+}
+
+FPS2ActorExportDataPtr FPS2ActorExportCache::Find(const AActor* Actor, uint32 Fingerprint)
+{
+	check(IsInGameThread());
+
+	const FPS2ActorExportDataPtr* Data = PS2ActorExportCache::Actors.Find(TObjectKey<AActor>(Actor));
+	if (Data && (*Data)->Fingerprint == Fingerprint)
+	{
+		return *Data;
+	}
+	return nullptr;
+}
+
+void FPS2ActorExportCache::Add(const AActor* Actor, FPS2ActorExportDataPtr Data)
+{
+	check(IsInGameThread());
+	PS2ActorExportCache::Actors.Add(TObjectKey<AActor>(Actor), MoveTemp(Data));
+}
+
+void FPS2ActorExportCache::Invalidate()
+{
+	PS2ActorExportCache::Actors.Reset();
+}
+
+void FPS2ActorExportCache::Invalidate(const AActor* Actor)
+{
+	if (Actor)
+	{
+		PS2ActorExportCache::Actors.Remove(TObjectKey<AActor>(Actor));
+	}
+}
+
+void FPS2ActorExportCache::RegisterDelegates()
+{
+	using namespace PS2ActorExportCache;
+
+	if (GEngine)
+	{
+		ActorMovedHandle = GEngine->OnActorMoved().AddLambda([](AActor* Actor)
+			{
+				FPS2ActorExportCache::Invalidate(Actor);
+			}
+		);
+	}
+
+	ObjectModifiedHandle = FCoreUObjectDelegates::OnObjectModified.AddStatic(&InvalidateOwner);
+	PropertyChangedHandle = FCoreUObjectDelegates::OnObjectPropertyChanged.AddLambda([](UObject* Object, FPropertyChangedEvent&)
+		{
+			InvalidateOwner(Object);
+		}
+	);
+
+	// Undo restores objects without marking them modified, and a different map has different actors
+	UndoRedoHandle = FEditorDelegates::PostUndoRedo.AddLambda([]() { FPS2ActorExportCache::Invalidate(); });
+	MapOpenedHandle = FEditorDelegates::OnMapOpened.AddLambda([](const FString&, bool) { FPS2ActorExportCache::Invalidate(); });
+
+	// Reimported meshes can change their references and bounds, and the settings decide what's exported
+	if (GEditor)
+	{
+		if (UImportSubsystem* ImportSubsystem = GEditor->GetEditorSubsystem<UImportSubsystem>())
+		{
+			ReimportHandle = ImportSubsystem->OnAssetReimport.AddLambda([](UObject*)
+				{
+					FPS2ActorExportCache::Invalidate();
+				}
+			);
+		}
+	}
+	SettingsChangedHandle = UPS2LevelEditingDeveloperSettings::Get()->OnSettingChanged().AddLambda([](UObject*, FPropertyChangedEvent&)
+		{
+			FPS2ActorExportCache::Invalidate();
+		}
+	);
+}
+
+void FPS2ActorExportCache::UnregisterDelegates()
+{
+	using namespace PS2ActorExportCache;
+
+	if (GEngine && ActorMovedHandle.IsValid())
+	{
+		GEngine->OnActorMoved().Remove(ActorMovedHandle);
+	}
+	ActorMovedHandle.Reset();
+
+	FCoreUObjectDelegates::OnObjectModified.Remove(ObjectModifiedHandle);
+	ObjectModifiedHandle.Reset();
+	FCoreUObjectDelegates::OnObjectPropertyChanged.Remove(PropertyChangedHandle);
+	PropertyChangedHandle.Reset();
+	FEditorDelegates::PostUndoRedo.Remove(UndoRedoHandle);
+	UndoRedoHandle.Reset();
+	FEditorDelegates::OnMapOpened.Remove(MapOpenedHandle);
+	MapOpenedHandle.Reset();
+
+	if (GEditor && ReimportHandle.IsValid())
+	{
+		if (UImportSubsystem* ImportSubsystem = GEditor->GetEditorSubsystem<UImportSubsystem>())
+		{
+			ImportSubsystem->OnAssetReimport.Remove(ReimportHandle);
+		}
+	}
+	ReimportHandle.Reset();
+
+	if (UObjectInitialized() && SettingsChangedHandle.IsValid())
+	{
+		UPS2LevelEditingDeveloperSettings::Get()->OnSettingChanged().Remove(SettingsChangedHandle);
+	}
+	SettingsChangedHandle.Reset();
+
+	Invalidate();
+}
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "egg/asset.hpp"
+
+class AActor;
+
+/** One actor's contribution to an exported level, converted to PS2 transforms. */
+struct FPS2ActorExportData
+{
+	// Cheap summary of the actor's mesh components when this was built, see FPS2ActorExportCache::ComputeFingerprint
+	uint32 Fingerprint = 0;
+
+	// Meshes exported individually, in component order
+	TArray<UE::Math::TMatrix<float>> MeshTransforms;
+	TArray<Asset::Reference> MeshFileReferences;
+
+	// Foliage components when foliage is grouped, in component order
+	struct FFoliage
+	{
+		Asset::Reference Reference;
+		TArray<UE::Math::TMatrix<float>> Transforms;
+	};
+	TArray<FFoliage> Foliage;
+
+	// Local bounds of each mesh the actor uses, in the PS2 basis
+	TArray<TPair<Asset::Reference, FBox3f>> MeshBounds;
+};
+
+using FPS2ActorExportDataPtr = TSharedPtr<const FPS2ActorExportData, ESPMode::ThreadSafe>;
+
+/**
+ * Keeps what each actor exported last time so an export only has to collect and convert the actors that changed.
+ * Actors are marked dirty when they're moved, modified or have a property changed, which covers foliage and instance
+ * edits as those modify their component. A fingerprint of the actor's components is checked as well, in case a change
+ * slipped past the delegates. Everything is dropped on undo, reimport, map changes and when the developer settings change.
+ *
+ * Game thread only.
+ */
+class FPS2ActorExportCache
+{
+public:
+	/** Hashes the actor's static mesh components, their meshes, transforms and instance transforms. */
+	static uint32 ComputeFingerprint(const AActor* Actor);
+
+	/** Returns the actor's cached export if it's still clean and matches Fingerprint. */
+	static FPS2ActorExportDataPtr Find(const AActor* Actor, uint32 Fingerprint);
+
+	static void Add(const AActor* Actor, FPS2ActorExportDataPtr Data);
+
+	static void Invalidate();
+	static void Invalidate(const AActor* Actor);
+
+	static void RegisterDelegates();
+	static void UnregisterDelegates();
+};
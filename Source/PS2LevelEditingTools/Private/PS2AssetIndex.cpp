@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2AssetIndex.h"
+#include "Misc/ScopeRWLock.h"
+
+namespace PS2AssetIndex
+{
+	// References are plain data, so hash their bytes and compare them with the library's operator==
+	struct FReferenceKeyFuncs : BaseKeyFuncs<Asset::Reference, Asset::Reference, false>
+	{
+		static const Asset::Reference& GetSetKey(const Asset::Reference& Element) { return Element; }
+		static bool Matches(const Asset::Reference& A, const Asset::Reference& B) { return A == B; }
+		static uint32 GetKeyHash(const Asset::Reference& Key) { return FCrc::MemCrc32(&Key, sizeof(Asset::Reference)); }
+	};
+
+	static FRWLock Lock;
+	static TSet<Asset::Reference, FReferenceKeyFuncs> TableReferences;
+	static TPS2AssetReferenceMap<FString> ReferencePaths;
+}
+
+void FPS2AssetIndex::Rebuild()
+{
+	TSet<Asset::Reference, PS2AssetIndex::FReferenceKeyFuncs> NewTableReferences;
+	for (const Asset::Reference& TableKey : Asset::get_asset_table().keys)
+	{
+		NewTableReferences.Add(TableKey);
+	}
+
+	FWriteScopeLock WriteLock(PS2AssetIndex::Lock);
+	PS2AssetIndex::TableReferences = MoveTemp(NewTableReferences);
+}
+
+bool FPS2AssetIndex::Contains(const Asset::Reference& Reference)
+{
+	FReadScopeLock ReadLock(PS2AssetIndex::Lock);
+	return PS2AssetIndex::TableReferences.Contains(Reference);
+}
+
+Asset::Reference FPS2AssetIndex::MakeReference(const FString& Path)
+{
+	Filesystem::Path p = TCHAR_TO_ANSI(*Path);
+	Asset::Reference Reference(p);
+
+	{
+		FReadScopeLock ReadLock(PS2AssetIndex::Lock);
+		if (PS2AssetIndex::ReferencePaths.Contains(Reference))
+		{
+			return Reference;
+		}
+	}
+
+	FWriteScopeLock WriteLock(PS2AssetIndex::Lock);
+	PS2AssetIndex::ReferencePaths.Add(Reference, Path);
+	return Reference;
+}
+
+FString FPS2AssetIndex::FindPath(const Asset::Reference& Reference)
+{
+	FReadScopeLock ReadLock(PS2AssetIndex::Lock);
+	const FString* Path = PS2AssetIndex::ReferencePaths.Find(Reference);
+	return Path ? *Path : FString();
+}
+
+int32 FPS2AssetIndex::Num()
+{
+	FReadScopeLock ReadLock(PS2AssetIndex::Lock);
+	return PS2AssetIndex::TableReferences.Num();
+}
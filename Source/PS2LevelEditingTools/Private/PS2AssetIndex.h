@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Crc.h"
+
+#include "egg/asset.hpp"
+
+/** Key funcs for maps keyed on Asset::Reference. References are plain data so their bytes are hashed. */
+template<typename ValueType>
+struct TPS2AssetReferenceMapKeyFuncs : TDefaultMapKeyFuncs<Asset::Reference, ValueType, false>
+{
+	static bool Matches(const Asset::Reference& A, const Asset::Reference& B) { return A == B; }
+	static uint32 GetKeyHash(const Asset::Reference& Key) { return FCrc::MemCrc32(&Key, sizeof(Asset::Reference)); }
+};
+
+template<typename ValueType>
+using TPS2AssetReferenceMap = TMap<Asset::Reference, ValueType, FDefaultSetAllocator, TPS2AssetReferenceMapKeyFuncs<ValueType>>;
+
+/**
+ * Hashed view of the PS2 asset table. The table is scanned once when the manifest is loaded so existence checks
+ * during export don't have to walk it. Also remembers which source path each reference was made from so missing
+ * references can be reported by name.
+ *
+ * All functions are safe to call from any thread.
+ */
+class FPS2AssetIndex
+{
+public:
+	/** Rebuilds the index from Asset::get_asset_table(). Call after the table has been (re)loaded. */
+	static void Rebuild();
+
+	/** Returns true if the reference is in the asset table. */
+	static bool Contains(const Asset::Reference& Reference);
+
+	/** Makes a reference from a path relative to the manifest directory and remembers the path it came from. */
+	static Asset::Reference MakeReference(const FString& Path);
+
+	/** Returns the path a reference was made from, or an empty string if it wasn't made through MakeReference. */
+	static FString FindPath(const Asset::Reference& Reference);
+
+	/** Number of references in the asset table. */
+	static int32 Num();
+};
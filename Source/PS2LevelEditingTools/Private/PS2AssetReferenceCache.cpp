@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2AssetReferenceCache.h"
+#include "PS2AssetIndex.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingTools.h"
+#include "PS2LevelEditingTools/PS2StaticMeshComponent.h"
+#include "EditorFramework/AssetImportData.h"
+#include "Engine/StaticMesh.h"
+#include "Editor.h"
+#include "Subsystems/ImportSubsystem.h"
+#include "UObject/ObjectKey.h"
+
+namespace PS2AssetReferenceCache
+{
+	// Unset if the mesh was looked at but doesn't come from the manifest directory
+	static TMap<TObjectKey<UStaticMesh>, TOptional<Asset::Reference>> ResolvedMeshes;
+
+	static FDelegateHandle ReimportHandle;
+	static FDelegateHandle SettingsChangedHandle;
+
+	static TOptional<Asset::Reference> ResolveStaticMesh(const UStaticMesh* StaticMesh)
+	{
+		const UAssetImportData* MeshImportData = StaticMesh->GetAssetImportData();
+		if (MeshImportData == nullptr || MeshImportData->GetSourceData().SourceFiles.Num() == 0)
+		{
+			return {};
+		}
+
+		const FAssetImportInfo::FSourceFile& SourceFile = MeshImportData->GetSourceData().SourceFiles[0];
+
+		FFilePath AssetManifestPath = UPS2LevelEditingDeveloperSettings::Get()->ManifestPath;
+		FString AssetFilePath{ SourceFile.RelativeFilename };
+
+		FDirectoryPath AssetManifestDirectory{ FPaths::GetPath(AssetManifestPath.FilePath) };
+
+		if (!FPaths::IsUnderDirectory(AssetFilePath, AssetManifestDirectory.Path))
+		{
+			return {};
+		}
+
+		FPaths::MakePathRelativeTo(AssetFilePath, *(AssetManifestDirectory.Path + "/"));
+
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Asset path: %s"), *AssetFilePath);
+		return FPS2AssetIndex::MakeReference(AssetFilePath);
+	}
+}
+
+TOptional<Asset::Reference> FPS2AssetReferenceCache::Resolve(const UStaticMeshComponent* Component)
+{
+	check(IsInGameThread());
+
+	if (const UPS2StaticMeshComponent* PS2Component = Cast<UPS2StaticMeshComponent>(Component))
+	{
+		if (!PS2Component->AssetPath.IsEmpty())
+		{
+			return FPS2AssetIndex::MakeReference(PS2Component->AssetPath);
+		}
+	}
+
+	const UStaticMesh* StaticMesh = Component->GetStaticMesh();
+	if (StaticMesh == nullptr)
+	{
+		return {};
+	}
+
+	if (const TOptional<Asset::Reference>* Resolved = PS2AssetReferenceCache::ResolvedMeshes.Find(TObjectKey<UStaticMesh>(StaticMesh)))
+	{
+		return *Resolved;
+	}
+
+	return PS2AssetReferenceCache::ResolvedMeshes.Add(TObjectKey<UStaticMesh>(StaticMesh), PS2AssetReferenceCache::ResolveStaticMesh(StaticMesh));
+}
+
+void FPS2AssetReferenceCache::Invalidate()
+{
+	PS2AssetReferenceCache::ResolvedMeshes.Reset();
+}
+
+void FPS2AssetReferenceCache::Invalidate(const UObject* Asset)
+{
+	if (const UStaticMesh* StaticMesh = Cast<UStaticMesh>(Asset))
+	{
+		PS2AssetReferenceCache::ResolvedMeshes.Remove(TObjectKey<UStaticMesh>(StaticMesh));
+	}
+}
+
+void FPS2AssetReferenceCache::RegisterDelegates()
+{
+	if (GEditor)
+	{
+		if (UImportSubsystem* ImportSubsystem = GEditor->GetEditorSubsystem<UImportSubsystem>())
+		{
+			PS2AssetReferenceCache::ReimportHandle = ImportSubsystem->OnAssetReimport.AddLambda([](UObject* Asset)
+				{
+					FPS2AssetReferenceCache::Invalidate(Asset);
+				}
+			);
+		}
+	}
+
+	// The manifest directory the meshes are resolved against is a setting
+	PS2AssetReferenceCache::SettingsChangedHandle = UPS2LevelEditingDeveloperSettings::Get()->OnSettingChanged().AddLambda([](UObject*, FPropertyChangedEvent&)
+		{
+			FPS2AssetReferenceCache::Invalidate();
+		}
+	);
+}
+
+void FPS2AssetReferenceCache::UnregisterDelegates()
+{
+	if (GEditor && PS2AssetReferenceCache::ReimportHandle.IsValid())
+	{
+		if (UImportSubsystem* ImportSubsystem = GEditor->GetEditorSubsystem<UImportSubsystem>())
+		{
+			ImportSubsystem->OnAssetReimport.Remove(PS2AssetReferenceCache::ReimportHandle);
+		}
+	}
+	PS2AssetReferenceCache::ReimportHandle.Reset();
+
+	if (UObjectInitialized() && PS2AssetReferenceCache::SettingsChangedHandle.IsValid())
+	{
+		UPS2LevelEditingDeveloperSettings::Get()->OnSettingChanged().Remove(PS2AssetReferenceCache::SettingsChangedHandle);
+	}
+	PS2AssetReferenceCache::SettingsChangedHandle.Reset();
+
+	Invalidate();
+}
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "egg/asset.hpp"
+
+class UStaticMeshComponent;
+
+/**
+ * Remembers which PS2 asset each static mesh was imported from so export only works it out once per mesh rather than
+ * once per component. Entries are dropped when their mesh is reimported and the whole cache is cleared when the
+ * developer settings change.
+ *
+ * Game thread only.
+ */
+class FPS2AssetReferenceCache
+{
+public:
+	/**
+	 * Returns the asset a component's mesh should be exported as. A UPS2StaticMeshComponent with an AssetPath set
+	 * uses that path directly, anything else resolves the source file its static mesh was imported from.
+	 *
+	 * @return The reference, or nothing if the mesh wasn't imported from under the manifest directory.
+	 */
+	static TOptional<Asset::Reference> Resolve(const UStaticMeshComponent* Component);
+
+	static void Invalidate();
+	static void Invalidate(const UObject* Asset);
+
+	static void RegisterDelegates();
+	static void UnregisterDelegates();
+};
@@ -2,256 +2,632 @@
 
 #include "PS2LevelEditingTools.h"
 #include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingStats.h"
+#include "PS2ActorExportCache.h"
+#include "PS2AssetIndex.h"
+#include "PS2AssetReferenceCache.h"
+#include "PS2LevelFile.h"
+#include "PS2LevelPartition.h"
+#include "PS2StaticBatching.h"
 #include "EditorFramework/AssetImportData.h"
 
 #include "FoliageInstancedStaticMeshComponent.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Framework/Notifications/NotificationManager.h"
+#include "HAL/FileManager.h"
+#include "Widgets/Notifications/SNotificationList.h"
+
+#include <atomic>
 
 #include "egg/math_types.hpp"
-#include "egg/level.hpp"
 #include "egg/asset.hpp"
 
-static void SwitchTransform(FTransform& Transform, EAxis::Type FrontAxis, EAxis::Type RightAxis, EAxis::Type UpAxis)
+#define LOCTEXT_NAMESPACE "PS2LevelEditingMapExport"
+
+namespace PS2LevelEditingMapExport
 {
-	FVector Location = Transform.GetLocation();
-	FVector NewLocation;
-	NewLocation[0] = Location.GetComponentForAxis(FrontAxis);
-	NewLocation[1] = Location.GetComponentForAxis(RightAxis);
-	NewLocation[2] = Location.GetComponentForAxis(UpAxis);
-
-	FVector Scale = Transform.GetScale3D();
-	FVector NewScale;
-	NewScale[0] = Scale.GetComponentForAxis(FrontAxis);
-	NewScale[1] = Scale.GetComponentForAxis(RightAxis);
-	NewScale[2] = Scale.GetComponentForAxis(UpAxis);
-
-	FQuat Orientation = Transform.GetRotation();
-	FQuat NewOrientation;
-	switch (FrontAxis)
-	{
-	case EAxis::X:		NewOrientation.X = Orientation.X;	break;
-	//case EAxis::XNeg:	NewOrientation.X = -Orientation.X;	break;
-	case EAxis::Y:		NewOrientation.X = Orientation.Y;	break;
-	//case EAxis::YNeg:	NewOrientation.X = -Orientation.Y;	break;
-	case EAxis::Z:		NewOrientation.X = Orientation.Z;	break;
-	//case EAxis::ZNeg:	NewOrientation.X = -Orientation.Z;	break;
+	// The level file still being written, game thread only
+	static TFuture<void> PendingWrite;
+	static TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> PendingWriteCancelled;
+}
+
+// Logs every distinct reference that isn't in the asset table, by the path it was made from. Static mesh batches are
+// written by the export itself, so they're only in the table once the asset pipeline has run since
+static void ReportUnresolvedReferences(const FPS2LevelData& Level, const TSet<FString>& BatchPaths)
+{
+	TSet<FString> UnresolvedPaths;
+	TSet<FString> UnresolvedBatchPaths;
+	auto CheckReference = [&UnresolvedPaths, &UnresolvedBatchPaths, &BatchPaths](const Asset::Reference& Reference)
+	{
+		if (!FPS2AssetIndex::Contains(Reference))
+		{
+			FString Path = FPS2AssetIndex::FindPath(Reference);
+			(BatchPaths.Contains(Path) ? UnresolvedBatchPaths : UnresolvedPaths).Add(MoveTemp(Path));
+		}
+	};
+
+	for (const Asset::Reference& Reference : Level.MeshFileReferences)
+	{
+		CheckReference(Reference);
 	}
-	switch (RightAxis)
-	{
-	case EAxis::X:		NewOrientation.Y = Orientation.X;	break;
-	//case EAxis::XNeg:	NewOrientation.Y = -Orientation.X;	break;
-	case EAxis::Y:		NewOrientation.Y = Orientation.Y;	break;
-	//case EAxis::YNeg:	NewOrientation.Y = -Orientation.Y;	break;
-	case EAxis::Z:		NewOrientation.Y = Orientation.Z;	break;
-	//case EAxis::ZNeg:	NewOrientation.Y = -Orientation.Z;	break;
+	for (const FPS2InstanceGroup& InstanceGroup : Level.InstanceGroups)
+	{
+		CheckReference(InstanceGroup.Mesh);
 	}
-	switch (UpAxis)
-	{
-	case EAxis::X:		NewOrientation.Z = Orientation.X;	break;
-	//case EAxis::XNeg:	NewOrientation.Z = -Orientation.X;	break;
-	case EAxis::Y:		NewOrientation.Z = Orientation.Y;	break;
-	//case EAxis::YNeg:	NewOrientation.Z = -Orientation.Y;	break;
-	case EAxis::Z:		NewOrientation.Z = Orientation.Z;	break;
-	//case EAxis::ZNeg:	NewOrientation.Z = -Orientation.Z;	break;
+
+	for (const FString& Path : UnresolvedPaths)
+	{
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Exported asset isn't in the PS2 asset manifest: %s"), *Path);
 	}
+	if (UnresolvedBatchPaths.Num() > 0)
+	{
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("%d static mesh batches aren't in the PS2 asset manifest yet, run the asset pipeline to add them"), UnresolvedBatchPaths.Num());
+	}
+	ensureMsgf(UnresolvedPaths.Num() == 0, TEXT("%d exported assets aren't in the PS2 asset manifest"), UnresolvedPaths.Num());
+}
 
-	// Calculate the Levi-Civita symbol for W scaling according to the following table
-	// +1 xyz yzx zxy
-	// -1 xzy yxz zyx
-	// 0 if any axes are duplicated (x == y, y == z, or z == x)
-	float LCSymbol = 0.0f;
-	EAxis::Type FrontAxisAbs = FrontAxis;
-	EAxis::Type RightAxisAbs = RightAxis;
-	EAxis::Type UpAxisAbs = UpAxis;
-	if (((FrontAxisAbs == EAxis::X) && (RightAxisAbs == EAxis::Y) && (UpAxisAbs == EAxis::Z)) ||
-		((FrontAxisAbs == EAxis::Y) && (RightAxisAbs == EAxis::Z) && (UpAxisAbs == EAxis::X)) ||
-		((FrontAxisAbs == EAxis::Z) && (RightAxisAbs == EAxis::X) && (UpAxisAbs == EAxis::Y)))
-	{
-		LCSymbol = 1.0f;
+static void ReportTransformEncoding(const FPS2LevelWriteOptions& Options, const FPS2LevelWriteReport& Report)
+{
+	if (Options.TransformEncoding != EPS2TransformEncoding::Compact)
+	{
+		return;
 	}
-	else if (((FrontAxisAbs == EAxis::X) && (RightAxisAbs == EAxis::Z) && (UpAxisAbs == EAxis::Y)) ||
-		((FrontAxisAbs == EAxis::Y) && (RightAxisAbs == EAxis::X) && (UpAxisAbs == EAxis::Z)) ||
-		((FrontAxisAbs == EAxis::Z) && (RightAxisAbs == EAxis::Y) && (UpAxisAbs == EAxis::X)))
+
+	UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Compact transforms: %d transforms in %d sections, %lld bytes saved, max position error %f, max basis error %f"),
+		Report.NumCompactTransforms, Report.NumCompactSections, int64(Report.NumBytesSaved), Report.MaxPositionError, Report.MaxBasisError);
+
+	if (Report.NumRejectedSections > 0)
 	{
-		LCSymbol = -1.0f;
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("%d sections were stored as matrices, compact transforms would be off by up to %f units and %f basis error (limits %f and %f)"),
+			Report.NumRejectedSections, Report.MaxRejectedPositionError, Report.MaxRejectedBasisError, Options.MaxPositionError, Options.MaxBasisError);
 	}
+}
+
+static FString GetLevelOutputPath(const UWorld* World)
+{
+	const UPS2LevelEditingDeveloperSettings* Settings = UPS2LevelEditingDeveloperSettings::Get();
 
-	// Make sure the handedness is corrected to match the remapping
-	const float FlipSign = 1.f;
+	FString OutputName = Settings->DefaultLevelOutputName;
+	if (World)
+	{
+		if (const FString* LevelOutputName = Settings->LevelOutputNames.Find(TSoftObjectPtr<UWorld>(World)))
+		{
+			OutputName = *LevelOutputName;
+		}
+	}
 
-	NewOrientation.W = Orientation.W * LCSymbol * FlipSign;
+	FString AssetManifestDirectory(FPaths::GetPath(Settings->ManifestPath.FilePath));
 
-	Transform.SetComponents(NewOrientation.GetNormalized(), NewLocation, NewScale);
+	return AssetManifestDirectory / "assets" / FPaths::SetExtension(OutputName, TEXT("lvl"));
 }
 
-static Asset::Reference LookupAssetReference(const FString& Path)
+// Static mesh batches go in a directory of their own next to the level, so each export can replace them as a whole
+static FString GetBatchOutputDirectory(const FString& LevelOutputPath)
 {
-	Filesystem::Path p = TCHAR_TO_ANSI(*Path);
-	return Asset::Reference(p);
+	return FPaths::GetPath(LevelOutputPath) / (FPaths::GetBaseFilename(LevelOutputPath) + TEXT("_batches"));
 }
 
-static bool AssetExists(Asset::Reference Ref)
+// Writes the level on a worker thread with a notification showing progress and a button to cancel. The level is written
+// to a temporary file which replaces OutputPath once it's complete, along with the staged static mesh batches it uses, so
+// a cancelled or failed write leaves any previous export in place
+static void WriteoutLevel(FPS2LevelData&& Level, const FString& OutputPath, const FPS2StaticBatchDirectories& BatchDirectories, const TSharedRef<FPS2OperationReport, ESPMode::ThreadSafe>& OperationReport)
 {
-	for (Asset::Reference TableKey : Asset::get_asset_table().keys)
+	using namespace PS2LevelEditingMapExport;
+
+	check(IsInGameThread());
+	check(!PendingWrite.IsValid() || PendingWrite.IsReady());
+
+	FPS2LevelWriteOptions Options;
+	Options.TransformEncoding = UPS2LevelEditingDeveloperSettings::Get()->TransformEncoding;
+	Options.MaxPositionError = UPS2LevelEditingDeveloperSettings::Get()->CompactMaxPositionError;
+	Options.MaxBasisError = UPS2LevelEditingDeveloperSettings::Get()->CompactMaxBasisError;
+
+	// Settings are only read on the game thread
+	const FString ReportDirectory = FPS2OperationReport::GetReportDirectory();
+
+	TSharedRef<std::atomic<bool>, ESPMode::ThreadSafe> bCancelled = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+
+	FNotificationInfo Info(FText::Format(LOCTEXT("WritingLevel", "Writing {0}"), FText::FromString(FPaths::GetCleanFilename(OutputPath))));
+	Info.bFireAndForget = false;
+	Info.ButtonDetails.Add(FNotificationButtonInfo(
+		LOCTEXT("CancelWrite", "Cancel"),
+		LOCTEXT("CancelWriteToolTip", "Stop writing the level. Any previous export is kept."),
+		FSimpleDelegate::CreateLambda([bCancelled]() { *bCancelled = true; }),
+		SNotificationItem::CS_Pending
+	));
+	TSharedPtr<SNotificationItem> Notification = FSlateNotificationManager::Get().AddNotification(Info);
+	if (Notification)
 	{
-		if (TableKey == Ref)
+		Notification->SetCompletionState(SNotificationItem::CS_Pending);
+	}
+
+	PendingWriteCancelled = bCancelled;
+	PendingWrite = Async(EAsyncExecution::ThreadPool, [Level = MoveTemp(Level), OutputPath, BatchDirectories, Options, bCancelled, Notification, OperationReport, ReportDirectory]()
 		{
-			return true;
+			const FString TempPath = OutputPath + TEXT(".tmp");
+
+			FPS2LevelWriteReport Report;
+			bool bWritten = false;
+			TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileWriter(*TempPath));
+			if (Ar)
+			{
+				PS2_SCOPE_PHASE(&OperationReport.Get(), WriteoutLevel);
+
+				int32 LastPercent = -1;
+				bWritten = SerializePS2Level(Level, *Ar, Options, &Report, [&LastPercent, &bCancelled, &Notification](float Fraction)
+					{
+						const int32 Percent = FMath::FloorToInt32(Fraction * 100.f);
+						if (Notification && Percent != LastPercent)
+						{
+							LastPercent = Percent;
+							AsyncTask(ENamedThreads::GameThread, [Notification, Percent]()
+								{
+									Notification->SetSubText(FText::Format(LOCTEXT("WriteProgress", "{0}%"), Percent));
+								}
+							);
+						}
+						return !*bCancelled;
+					}
+				);
+				PS2_ADD_COUNTER(&OperationReport.Get(), BytesWritten, Ar->Tell());
+				bWritten = Ar->Close() && bWritten;
+			}
+
+			// The batches go in first and are put back if the level can't follow them
+			bool bSaved = bWritten && (!BatchDirectories.IsSet() || BatchDirectories.SwapIn());
+			if (bSaved)
+			{
+				bSaved = IFileManager::Get().Move(*OutputPath, *TempPath);
+				if (!bSaved && BatchDirectories.IsSet())
+				{
+					BatchDirectories.Restore();
+				}
+			}
+			if (!bSaved)
+			{
+				IFileManager::Get().Delete(*TempPath, false, false, true);
+			}
+			if (BatchDirectories.IsSet())
+			{
+				BatchDirectories.Cleanup();
+			}
+
+			if (bSaved)
+			{
+				ReportTransformEncoding(Options, Report);
+				UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Exported PS2 map to %s"), *OutputPath);
+
+				if (!ReportDirectory.IsEmpty())
+				{
+					OperationReport->Write(ReportDirectory);
+				}
+			}
+			else if (!*bCancelled)
+			{
+				UE_LOG(LogPS2LevelEditingTools, Error, TEXT("Failed to write PS2 map to %s"), *OutputPath);
+			}
+
+			if (Notification)
+			{
+				const bool bWasCancelled = *bCancelled;
+				AsyncTask(ENamedThreads::GameThread, [Notification, bSaved, bWasCancelled]()
+					{
+						Notification->SetSubText(FText::GetEmpty());
+						Notification->SetText(bSaved ? LOCTEXT("WriteComplete", "PS2 map exported") : bWasCancelled ? LOCTEXT("WriteCancelled", "PS2 map export cancelled") : LOCTEXT("WriteFailed", "PS2 map export failed"));
+						Notification->SetCompletionState(bSaved ? SNotificationItem::CS_Success : SNotificationItem::CS_Fail);
+						Notification->ExpireAndFadeout();
+					}
+				);
+			}
 		}
+	);
+}
+
+void FPS2LevelEditingToolsModule::CancelExport()
+{
+	using namespace PS2LevelEditingMapExport;
+
+	if (PendingWriteCancelled)
+	{
+		*PendingWriteCancelled = true;
+	}
+	if (PendingWrite.IsValid())
+	{
+		PendingWrite.Wait();
 	}
-	return false;
 }
 
-static void WriteoutLevel(const TArray<UE::Math::TMatrix<float>>& MeshTransforms, const TArray<Asset::Reference>& MeshFileReferences)
+// A mesh component gathered on the game thread, converted to PS2 transforms afterwards
+struct FPS2CollectedMesh
 {
-	std::vector<std::byte> out;
+	Asset::Reference Reference;
+	FTransform ComponentTransform;
 
-	LevelFileHeader NewLevel;
-	NewLevel.meshes.mesh_files.set((intptr_t)MeshFileReferences.GetData(), MeshFileReferences.Num() * sizeof(Asset::Reference));
-	NewLevel.meshes.mesh_transforms.set((intptr_t)MeshTransforms.GetData(), MeshTransforms.Num() * sizeof(Matrix));
+	// Local bounds of the static mesh, invalid if the component has none
+	FBox LocalBounds = FBox(ForceInit);
 
-	Serializer s(out);
-	serialize(s, NewLevel, 1);
-	s.finish_serialization();
+	// Instances of an instanced component, their transforms are relative to the component
+	TConstArrayView<FInstancedStaticMeshInstanceData> Instances;
+	bool bInstanced = false;
 
-	TArrayView<uint8> OutView((uint8*)out.data(), out.size());
+	int32 NumTransforms() const { return bInstanced ? Instances.Num() : 1; }
+};
 
-	FFilePath AssetManifestPath = UPS2LevelEditingDeveloperSettings::Get()->ManifestPath;
+static_assert(STRUCT_OFFSET(FInstancedStaticMeshInstanceData, Transform) == 0, "Instances are read as the matrix at the start of each element");
+static_assert(sizeof(UE::Math::TMatrix<float>) == sizeof(PS2LevelCore::FMatrix44), "Exported transforms are converted in place");
 
-	FString AssetManifestDirectory(FPaths::GetPath(AssetManifestPath.FilePath));
+static PS2LevelCore::FTransform ToCoreTransform(const FTransform& Transform)
+{
+	const FQuat Rotation = Transform.GetRotation();
+	const FVector Translation = Transform.GetTranslation();
+	const FVector Scale = Transform.GetScale3D();
 
-	FFileHelper::SaveArrayToFile(OutView, *(AssetManifestDirectory / "assets" / "new_level.lvl"));
+	return PS2LevelCore::FTransform
+	{
+		{ Rotation.X, Rotation.Y, Rotation.Z, Rotation.W },
+		{ Translation.X, Translation.Y, Translation.Z },
+		{ Scale.X, Scale.Y, Scale.Z },
+	};
 }
 
-static void CollectStaticMeshes(AActor* Actor, TArray<UE::Math::TMatrix<float>>& MeshTransforms, TArray<Asset::Reference>& MeshFileReferences)
+static void CollectStaticMeshes(AActor* Actor, bool bSkipFoliage, const TSet<const UStaticMeshComponent*>& BatchedMeshes, TArray<FPS2CollectedMesh>& CollectedMeshes, FPS2OperationReport* Report)
 {
 	TArray<UStaticMeshComponent*> Meshes;
 	Actor->GetComponents(Meshes);
 
 	for (UStaticMeshComponent* Mesh : Meshes)
 	{
-		FTransform Transform = Mesh->GetComponentTransform();
-		SwitchTransform(Transform, EAxis::X, EAxis::Z, EAxis::Y);
-		if (Mesh->GetStaticMesh())
+		if ((bSkipFoliage && Mesh->IsA<UFoliageInstancedStaticMeshComponent>()) || BatchedMeshes.Contains(Mesh))
+		{
+			continue;
+		}
+
+		TOptional<Asset::Reference> ResolvedReference = FPS2AssetReferenceCache::Resolve(Mesh);
+		PS2_ADD_COUNTER(Report, AssetLookups, 1);
+		if (ResolvedReference.IsSet())
 		{
-			UAssetImportData* MeshImportData = Mesh->GetStaticMesh()->GetAssetImportData();
-			if (MeshImportData->GetSourceData().SourceFiles.Num() > 0)
+			FPS2CollectedMesh& CollectedMesh = CollectedMeshes.AddDefaulted_GetRef();
+			CollectedMesh.Reference = ResolvedReference.GetValue();
+			CollectedMesh.ComponentTransform = Mesh->GetComponentTransform();
+			if (const UStaticMesh* StaticMesh = Mesh->GetStaticMesh())
+			{
+				CollectedMesh.LocalBounds = StaticMesh->GetBoundingBox();
+			}
+
+			if (UInstancedStaticMeshComponent* InstancedMesh = Cast<UInstancedStaticMeshComponent>(Mesh))
 			{
-				FAssetImportInfo::FSourceFile SourceFile = MeshImportData->GetSourceData().SourceFiles[0];
+				CollectedMesh.Instances = InstancedMesh->PerInstanceSMData;
+				CollectedMesh.bInstanced = true;
+			}
+		}
+	}
+}
 
-				FFilePath AssetManifestPath = UPS2LevelEditingDeveloperSettings::Get()->ManifestPath;
-				FString AssetFilePath{ SourceFile.RelativeFilename };
+// Converts the collected meshes into the level's flat transform and reference arrays. Every mesh is given its range of
+// the output up front and written in place, so the output is in collection order whether or not this runs in parallel
+static void ConvertCollectedMeshes(const TArray<FPS2CollectedMesh>& CollectedMeshes, bool bParallel, TArray<UE::Math::TMatrix<float>>& MeshTransforms, TArray<Asset::Reference>* MeshFileReferences)
+{
+	// Large instanced components are split up so a single foliage component doesn't end up on one worker
+	constexpr int32 MaxTransformsPerTask = 1024;
 
-				FDirectoryPath AssetManifestDirectory{ FPaths::GetPath(AssetManifestPath.FilePath) };
+	struct FConvertTask
+	{
+		int32 MeshIndex;
+		int32 FirstInstance;
+		int32 NumInstances;
+		int32 FirstOutput;
+	};
+
+	TArray<FConvertTask> Tasks;
+	int32 NumOutputs = 0;
+	for (int32 MeshIndex = 0; MeshIndex < CollectedMeshes.Num(); ++MeshIndex)
+	{
+		const int32 NumTransforms = CollectedMeshes[MeshIndex].NumTransforms();
+		for (int32 FirstInstance = 0; FirstInstance < NumTransforms; FirstInstance += MaxTransformsPerTask)
+		{
+			const int32 NumInstances = FMath::Min(MaxTransformsPerTask, NumTransforms - FirstInstance);
+			Tasks.Add({ MeshIndex, FirstInstance, NumInstances, NumOutputs });
+			NumOutputs += NumInstances;
+		}
+	}
 
-				if (FPaths::IsUnderDirectory(AssetFilePath, AssetManifestDirectory.Path))
+	const int32 FirstTransform = MeshTransforms.Num();
+	MeshTransforms.AddUninitialized(NumOutputs);
+	if (MeshFileReferences)
+	{
+		check(MeshFileReferences->Num() == FirstTransform);
+		MeshFileReferences->AddUninitialized(NumOutputs);
+	}
+
+	ParallelFor(Tasks.Num(), [&](int32 TaskIndex)
+		{
+			const FConvertTask& Task = Tasks[TaskIndex];
+			const FPS2CollectedMesh& CollectedMesh = CollectedMeshes[Task.MeshIndex];
+			const int32 Output = FirstTransform + Task.FirstOutput;
+
+			PS2LevelCore::FMatrix44* OutMatrices = reinterpret_cast<PS2LevelCore::FMatrix44*>(&MeshTransforms[Output]);
+			if (CollectedMesh.bInstanced)
+			{
+				const uint8* Instances = reinterpret_cast<const uint8*>(&CollectedMesh.Instances[Task.FirstInstance]);
+				PS2LevelCore::ConvertInstanceTransforms(Instances, sizeof(FInstancedStaticMeshInstanceData), Task.NumInstances, ToCoreTransform(CollectedMesh.ComponentTransform), OutMatrices);
+			}
+			else
+			{
+				*OutMatrices = PS2LevelCore::ConvertTransform(ToCoreTransform(CollectedMesh.ComponentTransform));
+			}
+
+			if (MeshFileReferences)
+			{
+				for (int32 Index = 0; Index < Task.NumInstances; ++Index)
 				{
-					FPaths::MakePathRelativeTo(AssetFilePath, *(AssetManifestDirectory.Path + "/"));
+					(*MeshFileReferences)[Output + Index] = CollectedMesh.Reference;
+				}
+			}
+		},
+		bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread
+	);
+}
 
-					UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Asset path: %s"), *AssetFilePath);
-					Asset::Reference AssetReference = LookupAssetReference(AssetFilePath);
-					ensure(AssetExists(AssetReference));
+static void CollectFoliageMeshes(AActor* Actor, TArray<FPS2CollectedMesh>& CollectedFoliage, FPS2OperationReport* Report)
+{
+	TArray<UFoliageInstancedStaticMeshComponent*> Meshes;
+	Actor->GetComponents(Meshes);
 
-					if (UInstancedStaticMeshComponent* InstancedMesh = Cast<UInstancedStaticMeshComponent>(Mesh))
-					{
-						int32 InstanceID = 0;
-						for (const FInstancedStaticMeshInstanceData& InstanceData : InstancedMesh->PerInstanceSMData)
-						{
-							FTransform InstanceTransform;
-							InstancedMesh->GetInstanceTransform(InstanceID, InstanceTransform, true);
-							SwitchTransform(InstanceTransform, EAxis::X, EAxis::Z, EAxis::Y);
+	for (UFoliageInstancedStaticMeshComponent* Mesh : Meshes)
+	{
+		TOptional<Asset::Reference> ResolvedReference = FPS2AssetReferenceCache::Resolve(Mesh);
+		PS2_ADD_COUNTER(Report, AssetLookups, 1);
+		if (ResolvedReference.IsSet() && Mesh->PerInstanceSMData.Num() > 0)
+		{
+			FPS2CollectedMesh& CollectedMesh = CollectedFoliage.AddDefaulted_GetRef();
+			CollectedMesh.Reference = ResolvedReference.GetValue();
+			CollectedMesh.ComponentTransform = Mesh->GetComponentTransform();
+			if (const UStaticMesh* StaticMesh = Mesh->GetStaticMesh())
+			{
+				CollectedMesh.LocalBounds = StaticMesh->GetBoundingBox();
+			}
+			CollectedMesh.Instances = Mesh->PerInstanceSMData;
+			CollectedMesh.bInstanced = true;
+		}
+	}
+}
 
-							UE::Math::TMatrix<double> UnrealMeshMatDouble = InstanceTransform.ToMatrixWithScale();
+// Local bounds of a collected mesh, switched to the PS2 basis the exported transforms are in
+static void AddMeshBounds(const FPS2CollectedMesh& CollectedMesh, FPS2ActorExportData& ActorData)
+{
+	if (!CollectedMesh.LocalBounds.IsValid || ActorData.MeshBounds.ContainsByPredicate([&CollectedMesh](const TPair<Asset::Reference, FBox3f>& Bounds) { return Bounds.Key == CollectedMesh.Reference; }))
+	{
+		return;
+	}
 
-							UE::Math::TMatrix<float>& MeshMatrix = MeshTransforms.AddDefaulted_GetRef();
-							for (int i = 0; i < 4; ++i)
-							{
-								for (int j = 0; j < 4; ++j)
-								{
-									MeshMatrix.M[i][j] = UnrealMeshMatDouble.M[i][j];
-								}
-							}
-							MeshFileReferences.Add(AssetReference);
+	const FVector3f Min(CollectedMesh.LocalBounds.Min.X, CollectedMesh.LocalBounds.Min.Z, CollectedMesh.LocalBounds.Min.Y);
+	const FVector3f Max(CollectedMesh.LocalBounds.Max.X, CollectedMesh.LocalBounds.Max.Z, CollectedMesh.LocalBounds.Max.Y);
+	ActorData.MeshBounds.Emplace(CollectedMesh.Reference, FBox3f(Min, Max));
+}
 
-							InstanceID++;
-						}
-					}
-					else
-					{
-						UE::Math::TMatrix<float>& MeshMatrix = MeshTransforms.AddDefaulted_GetRef();
-						UE::Math::TMatrix<double> UnrealMeshMatDouble = Transform.ToMatrixWithScale();
-						for (int i = 0; i < 4; ++i)
-						{
-							for (int j = 0; j < 4; ++j)
-							{
-								MeshMatrix.M[i][j] = UnrealMeshMatDouble.M[i][j];
-							}
-						}
-						MeshFileReferences.Add(AssetReference);
-					}
-				}
+// Collects and converts a set of actors. All of their meshes are converted in one go so small actors still keep the
+// workers busy, then the results are split back up by actor
+static void BuildActorExports(TConstArrayView<AActor*> Actors, bool bGroupFoliage, bool bParallel, const TSet<const UStaticMeshComponent*>& BatchedMeshes, TArray<TSharedRef<FPS2ActorExportData, ESPMode::ThreadSafe>>& OutActorData, FPS2OperationReport* Report)
+{
+	// UObjects are only touched here, on the game thread. Everything after works on the collected copies
+	TArray<FPS2CollectedMesh> CollectedMeshes;
+	TArray<FPS2CollectedMesh> CollectedFoliage;
+	TArray<int32> ActorMeshesEnd;
+	TArray<int32> ActorFoliageEnd;
+	{
+		PS2_SCOPE_PHASE(Report, CollectStaticMeshes);
+		for (AActor* Actor : Actors)
+		{
+			CollectStaticMeshes(Actor, bGroupFoliage, BatchedMeshes, CollectedMeshes, Report);
+			if (bGroupFoliage)
+			{
+				CollectFoliageMeshes(Actor, CollectedFoliage, Report);
 			}
+			ActorMeshesEnd.Add(CollectedMeshes.Num());
+			ActorFoliageEnd.Add(CollectedFoliage.Num());
 		}
 	}
+
+	TArray<UE::Math::TMatrix<float>> MeshTransforms;
+	TArray<Asset::Reference> MeshFileReferences;
+	TArray<UE::Math::TMatrix<float>> FoliageTransforms;
+	{
+		PS2_SCOPE_PHASE(Report, ConvertTransforms);
+		ConvertCollectedMeshes(CollectedMeshes, bParallel, MeshTransforms, &MeshFileReferences);
+		ConvertCollectedMeshes(CollectedFoliage, bParallel, FoliageTransforms, nullptr);
+	}
+
+	int32 MeshIndex = 0;
+	int32 MeshOutput = 0;
+	int32 FoliageIndex = 0;
+	int32 FoliageOutput = 0;
+	for (int32 ActorIndex = 0; ActorIndex < Actors.Num(); ++ActorIndex)
+	{
+		TSharedRef<FPS2ActorExportData, ESPMode::ThreadSafe> ActorData = MakeShared<FPS2ActorExportData, ESPMode::ThreadSafe>();
+
+		int32 NumMeshOutputs = 0;
+		for (; MeshIndex < ActorMeshesEnd[ActorIndex]; ++MeshIndex)
+		{
+			NumMeshOutputs += CollectedMeshes[MeshIndex].NumTransforms();
+			AddMeshBounds(CollectedMeshes[MeshIndex], *ActorData);
+		}
+		ActorData->MeshTransforms.Append(MeshTransforms.GetData() + MeshOutput, NumMeshOutputs);
+		ActorData->MeshFileReferences.Append(MeshFileReferences.GetData() + MeshOutput, NumMeshOutputs);
+		MeshOutput += NumMeshOutputs;
+
+		for (; FoliageIndex < ActorFoliageEnd[ActorIndex]; ++FoliageIndex)
+		{
+			const FPS2CollectedMesh& CollectedMesh = CollectedFoliage[FoliageIndex];
+			FPS2ActorExportData::FFoliage& Foliage = ActorData->Foliage.AddDefaulted_GetRef();
+			Foliage.Reference = CollectedMesh.Reference;
+			Foliage.Transforms.Append(FoliageTransforms.GetData() + FoliageOutput, CollectedMesh.NumTransforms());
+			FoliageOutput += CollectedMesh.NumTransforms();
+			AddMeshBounds(CollectedMesh, *ActorData);
+		}
+
+		OutActorData.Add(ActorData);
+	}
 }
 
-static void CollectFoliageMeshes(AActor* Actor, TArray<UE::Math::TMatrix<float>>& MeshTransforms, TArray<Asset::Reference>& MeshFileReferences)
+// Places the static mesh batches like individual meshes, as if they all belonged to one more actor
+static FPS2ActorExportDataPtr BuildBatchExport(TConstArrayView<FPS2StaticBatch> Batches, bool bParallel)
 {
-	TArray<UInstancedStaticMeshComponent*> Meshes;
-	Actor->GetComponents(Meshes);
+	TArray<FPS2CollectedMesh> CollectedMeshes;
+	for (const FPS2StaticBatch& Batch : Batches)
+	{
+		FPS2CollectedMesh& CollectedMesh = CollectedMeshes.AddDefaulted_GetRef();
+		CollectedMesh.Reference = Batch.Reference;
+		CollectedMesh.ComponentTransform = Batch.Transform;
+		CollectedMesh.LocalBounds = Batch.LocalBounds;
+	}
+
+	TSharedRef<FPS2ActorExportData, ESPMode::ThreadSafe> BatchData = MakeShared<FPS2ActorExportData, ESPMode::ThreadSafe>();
+	ConvertCollectedMeshes(CollectedMeshes, bParallel, BatchData->MeshTransforms, &BatchData->MeshFileReferences);
+	for (const FPS2CollectedMesh& CollectedMesh : CollectedMeshes)
+	{
+		AddMeshBounds(CollectedMesh, *BatchData);
+	}
+	return BatchData;
+}
 
-	for (UInstancedStaticMeshComponent* Mesh : Meshes)
-	{
-		//FTransform Transform = Mesh->GetComponentTransform();
-		//SwitchTransform(Transform, EAxis::X, EAxis::Z, EAxis::Y, false, FVector::Zero(), false, FRotator::ZeroRotator);
-
-		//Mesh->PerInstanceSMData
-
-		//if (Mesh->GetStaticMesh())
-		//{
-		//	UAssetImportData* MeshImportData = Mesh->GetStaticMesh()->GetAssetImportData();
-		//	if (MeshImportData->GetSourceData().SourceFiles.Num() > 0)
-		//	{
-		//		FAssetImportInfo::FSourceFile SourceFile = MeshImportData->GetSourceData().SourceFiles[0];
-
-		//		FFilePath AssetManifestPath = UPS2LevelEditingDeveloperSettings::Get()->ManifestPath;
-		//		FString AssetFilePath{ SourceFile.RelativeFilename };
-
-		//		FDirectoryPath AssetManifestDirectory{ FPaths::GetPath(AssetManifestPath.FilePath) };
-
-		//		if (FPaths::IsUnderDirectory(AssetFilePath, AssetManifestDirectory.Path))
-		//		{
-		//			FPaths::MakePathRelativeTo(AssetFilePath, *(AssetManifestDirectory.Path + "/"));
-
-		//			UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Asset path: %s"), *AssetFilePath);
-		//			Asset::Reference AssetReference = LookupAssetReference(AssetFilePath);
-		//			ensure(AssetExists(AssetReference));
-
-		//			UE::Math::TMatrix<float>& MeshMatrix = MeshTransforms.AddDefaulted_GetRef();
-		//			UE::Math::TMatrix<double> UnrealMeshMatDouble = Transform.ToMatrixWithScale();//(Transform * UPS2LevelEditingDeveloperSettings::Get()->ExportTransform).ToMatrixWithScale();
-		//			for (int i = 0; i < 4; ++i)
-		//			{
-		//				for (int j = 0; j < 4; ++j)
-		//				{
-		//					MeshMatrix.M[i][j] = UnrealMeshMatDouble.M[i][j];
-		//				}
-		//			}
-		//			MeshFileReferences.Add(AssetReference);
-		//		}
-		//	}
-		//}
+// Puts the actors' exports together into a level, in actor order. Foliage is grouped by mesh, so every mesh is stored
+// once and its instances are contiguous. Groups and the instances within them stay in the order they were collected
+static void AssembleLevel(TConstArrayView<FPS2ActorExportDataPtr> Actors, FPS2LevelData& Level, TPS2AssetReferenceMap<FBox3f>& MeshBounds)
+{
+	int32 NumMeshTransforms = 0;
+	for (const FPS2ActorExportDataPtr& ActorData : Actors)
+	{
+		NumMeshTransforms += ActorData->MeshTransforms.Num();
+	}
+	Level.MeshTransforms.Reserve(NumMeshTransforms);
+	Level.MeshFileReferences.Reserve(NumMeshTransforms);
+
+	TArray<PS2LevelCore::TInstanceBatch<Asset::Reference>> Batches;
+	for (const FPS2ActorExportDataPtr& ActorData : Actors)
+	{
+		Level.MeshTransforms.Append(ActorData->MeshTransforms);
+		Level.MeshFileReferences.Append(ActorData->MeshFileReferences);
+
+		for (const FPS2ActorExportData::FFoliage& Foliage : ActorData->Foliage)
+		{
+			Batches.Add({ Foliage.Reference, reinterpret_cast<const PS2LevelCore::FMatrix44*>(Foliage.Transforms.GetData()), size_t(Foliage.Transforms.Num()) });
+		}
+
+		for (const TPair<Asset::Reference, FBox3f>& Bounds : ActorData->MeshBounds)
+		{
+			if (!MeshBounds.Contains(Bounds.Key))
+			{
+				MeshBounds.Add(Bounds.Key, Bounds.Value);
+			}
+		}
 	}
+
+	std::vector<FPS2InstanceGroup> Groups;
+	std::vector<uint32> BatchGroups;
+	const size_t NumInstances = PS2LevelCore::GroupInstances(Batches.GetData(), Batches.Num(), Groups, BatchGroups);
+
+	Level.InstanceGroups.Append(Groups.data(), Groups.size());
+	Level.InstanceTransforms.SetNumUninitialized(NumInstances);
+	PS2LevelCore::CopyGroupedInstances(Batches.GetData(), Batches.Num(), BatchGroups.data(), Groups, reinterpret_cast<PS2LevelCore::FMatrix44*>(Level.InstanceTransforms.GetData()));
 }
 
 void FPS2LevelEditingToolsModule::ExportMap(TArray<AActor*> SelectedActors)
 {
-	TArray<UE::Math::TMatrix<float>> MeshTransforms;
-	TArray<Asset::Reference> MeshFileReferences;
+	if (PS2LevelEditingMapExport::PendingWrite.IsValid() && !PS2LevelEditingMapExport::PendingWrite.IsReady())
+	{
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("The previous PS2 map export is still being written, try again once it's done"));
+		return;
+	}
+
+	const bool bParallel = UPS2LevelEditingDeveloperSettings::Get()->bParallelExport;
+	const bool bGroupFoliage = UPS2LevelEditingDeveloperSettings::Get()->bGroupFoliageInstances;
+	const bool bIncremental = UPS2LevelEditingDeveloperSettings::Get()->bIncrementalExport;
+
+	const TSharedRef<FPS2OperationReport, ESPMode::ThreadSafe> Report = MakeShared<FPS2OperationReport, ESPMode::ThreadSafe>(TEXT("Export"));
+
+	const UWorld* World = SelectedActors.Num() > 0 ? SelectedActors[0]->GetWorld() : nullptr;
+	const FString OutputPath = GetLevelOutputPath(World);
+
+	// Batching runs first so the batched components can be left out of their actors' exports
+	FPS2StaticBatches StaticBatches;
+	if (UPS2LevelEditingDeveloperSettings::Get()->bBatchStaticMeshes)
+	{
+		PS2_SCOPE_PHASE(&Report.Get(), BatchStaticMeshes);
+		const FString ManifestDirectory = FPaths::GetPath(UPS2LevelEditingDeveloperSettings::Get()->ManifestPath.FilePath);
+		BuildPS2StaticBatches(SelectedActors, GetBatchOutputDirectory(OutputPath), ManifestDirectory, bParallel, StaticBatches, Report.Get());
+	}
 
-	for (AActor* Actor : SelectedActors)
+	// Only actors without an up to date cached export are collected again. Which of an actor's components are batched
+	// depends on its neighbours as well, so actors with batched components are always collected and never cached
+	TArray<FPS2ActorExportDataPtr> ActorExports;
+	ActorExports.SetNum(SelectedActors.Num());
+	TArray<AActor*> DirtyActors;
+	TArray<int32> DirtyActorIndices;
+	TArray<uint32> DirtyActorFingerprints;
+	for (int32 ActorIndex = 0; ActorIndex < SelectedActors.Num(); ++ActorIndex)
 	{
-		CollectStaticMeshes(Actor, MeshTransforms, MeshFileReferences);
-		CollectFoliageMeshes(Actor, MeshTransforms, MeshFileReferences);
+		AActor* Actor = SelectedActors[ActorIndex];
+		const bool bCached = bIncremental && !StaticBatches.BatchedActors.Contains(Actor);
+		const uint32 Fingerprint = bCached ? FPS2ActorExportCache::ComputeFingerprint(Actor) : 0;
+		if (bCached)
+		{
+			ActorExports[ActorIndex] = FPS2ActorExportCache::Find(Actor, Fingerprint);
+		}
+
+		if (!ActorExports[ActorIndex].IsValid())
+		{
+			DirtyActors.Add(Actor);
+			DirtyActorIndices.Add(ActorIndex);
+			DirtyActorFingerprints.Add(Fingerprint);
+		}
+	}
+
+	TArray<TSharedRef<FPS2ActorExportData, ESPMode::ThreadSafe>> BuiltActors;
+	BuildActorExports(DirtyActors, bGroupFoliage, bParallel, StaticBatches.BatchedMeshes, BuiltActors, &Report.Get());
+	for (int32 DirtyIndex = 0; DirtyIndex < DirtyActors.Num(); ++DirtyIndex)
+	{
+		BuiltActors[DirtyIndex]->Fingerprint = DirtyActorFingerprints[DirtyIndex];
+		ActorExports[DirtyActorIndices[DirtyIndex]] = BuiltActors[DirtyIndex];
+		if (bIncremental && !StaticBatches.BatchedActors.Contains(DirtyActors[DirtyIndex]))
+		{
+			FPS2ActorExportCache::Add(DirtyActors[DirtyIndex], BuiltActors[DirtyIndex]);
+		}
+	}
+
+	if (bIncremental)
+	{
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Exporting %d actors, %d changed since the last export"), SelectedActors.Num(), DirtyActors.Num());
 	}
 
-	WriteoutLevel(MeshTransforms, MeshFileReferences);
-}
\ No newline at end of file
+	if (StaticBatches.Batches.Num() > 0)
+	{
+		ActorExports.Add(BuildBatchExport(StaticBatches.Batches, bParallel));
+	}
+
+	FPS2LevelData Level;
+	TPS2AssetReferenceMap<FBox3f> MeshBounds;
+	{
+		PS2_SCOPE_PHASE(&Report.Get(), AssembleLevel);
+		AssembleLevel(ActorExports, Level, MeshBounds);
+	}
+	PS2_ADD_COUNTER(&Report.Get(), InstancesExported, Level.MeshTransforms.Num() + Level.InstanceTransforms.Num());
+
+	ReportUnresolvedReferences(Level, StaticBatches.Paths);
+
+	if (UPS2LevelEditingDeveloperSettings::Get()->bPartitionLevel)
+	{
+		PS2_SCOPE_PHASE(&Report.Get(), PartitionLevel);
+		// ClampMin only applies in the details panel, the ini can still hold anything
+		const float CellSize = FMath::Max(UPS2LevelEditingDeveloperSettings::Get()->PartitionCellSize, 100.f);
+		PartitionPS2Level(Level, MeshBounds, CellSize, bParallel);
+	}
+
+	Report->SetDetail(TEXT("Output"), OutputPath);
+	Report->SetDetail(TEXT("Actors"), FString::FromInt(SelectedActors.Num()));
+	Report->SetDetail(TEXT("ChangedActors"), FString::FromInt(DirtyActors.Num()));
+	Report->SetDetail(TEXT("StaticBatches"), FString::FromInt(StaticBatches.Batches.Num()));
+	WriteoutLevel(MoveTemp(Level), OutputPath, StaticBatches.Directories, Report);
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "PS2OperationReport.h"
+
+DECLARE_STATS_GROUP(TEXT("PS2 Level Editing"), STATGROUP_PS2LevelEditing, STATCAT_Advanced);
+
+// Phases, named after EPS2ReportPhase
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Translate"), STAT_PS2_Translate, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GetMeshPayloadData"), STAT_PS2_GetMeshPayloadData, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DecodeStrips"), STAT_PS2_DecodeStrips, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("WeldVertices"), STAT_PS2_WeldVertices, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("BuildMeshDescription"), STAT_PS2_BuildMeshDescription, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LoadManifest"), STAT_PS2_LoadManifest, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("CollectStaticMeshes"), STAT_PS2_CollectStaticMeshes, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("ConvertTransforms"), STAT_PS2_ConvertTransforms, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("AssembleLevel"), STAT_PS2_AssembleLevel, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("PartitionLevel"), STAT_PS2_PartitionLevel, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("WriteoutLevel"), STAT_PS2_WriteoutLevel, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("SimplifyLOD"), STAT_PS2_SimplifyLOD, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("BuildStrips"), STAT_PS2_BuildStrips, STATGROUP_PS2LevelEditing, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("BatchStaticMeshes"), STAT_PS2_BatchStaticMeshes, STATGROUP_PS2LevelEditing, );
+
+// Counters, named after EPS2ReportCounter. They add up over the editor session, in 64 bits so byte counts don't wrap
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Bytes read"), STAT_PS2_BytesRead, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vertices in"), STAT_PS2_VerticesIn, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vertices out"), STAT_PS2_VerticesOut, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Triangles in"), STAT_PS2_TrianglesIn, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Triangles out"), STAT_PS2_TrianglesOut, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Degenerates dropped"), STAT_PS2_DegeneratesDropped, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Payload cache hits"), STAT_PS2_PayloadCacheHits, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Instances exported"), STAT_PS2_InstancesExported, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asset lookups"), STAT_PS2_AssetLookups, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Bytes written"), STAT_PS2_BytesWritten, STATGROUP_PS2LevelEditing, );
+DECLARE_QWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Meshes batched"), STAT_PS2_MeshesBatched, STATGROUP_PS2LevelEditing, );
+
+/**
+ * Times the rest of the scope as a phase: an Insights CPU event, a cycle stat and a phase of the report, which may be
+ * null for work that isn't part of an import or export.
+ */
+#define PS2_SCOPE_PHASE(Report, Phase) \
+	TRACE_CPUPROFILER_EVENT_SCOPE(PS2_##Phase); \
+	SCOPE_CYCLE_COUNTER(STAT_PS2_##Phase); \
+	FPS2ReportPhaseScope PS2PhaseScope_##Phase(Report, EPS2ReportPhase::Phase)
+
+/** Adds to a counter stat and the same counter of the report, which may be null. */
+#define PS2_ADD_COUNTER(Report, Counter, Amount) \
+	do \
+	{ \
+		const int64 PS2CounterAmount = int64(Amount); \
+		INC_QWORD_STAT_BY(STAT_PS2_##Counter, PS2CounterAmount); \
+		if (FPS2OperationReport* PS2CounterReport = (Report)) \
+		{ \
+			PS2CounterReport->AddCounter(EPS2ReportCounter::Counter, PS2CounterAmount); \
+		} \
+	} \
+	while (0)
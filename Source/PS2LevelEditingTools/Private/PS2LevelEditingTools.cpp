@@ -6,42 +6,44 @@
 #include "InterchangeManager.h"
 #include "InterchangePS2ModelTranslator.h"
 #include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2ActorExportCache.h"
+#include "PS2AssetReferenceCache.h"
+#include "PS2ManifestLoader.h"
+#include "PS2LevelEditingStats.h"
 #include "LevelEditor.h"
 
-#include "egg/asset.hpp"
-
 FDelegateHandle LevelViewportExtenderHandle;
 
 DEFINE_LOG_CATEGORY(LogPS2LevelEditingTools);
 
-#define LOCTEXT_NAMESPACE "FPS2LevelEditingToolsModule"
-
-static void LoadManifest()
-{
-	FFilePath AssetManifestPath = UPS2LevelEditingDeveloperSettings::Get()->ManifestPath;
-	if (FPaths::FileExists(AssetManifestPath.FilePath))
-	{
-		const uint64 FileSize = FPlatformFileManager::Get().GetPlatformFile().FileSize(*AssetManifestPath.FilePath);
-		const uint64 ExpectedManifestSize = sizeof(Asset::AssetHashMapT);
-
-		if (FileSize != ExpectedManifestSize)
-		{
-			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Asset manifest file size mismatch! File size: %lu, Expected size: %lu"), FileSize, ExpectedManifestSize);
-			return;
-		}
-
-		TArray64<uint8> AssetManifestBytes;
-		AssetManifestBytes.Reserve(FileSize);
-		FFileHelper::LoadFileToArray(AssetManifestBytes, *AssetManifestPath.FilePath);
+DEFINE_STAT(STAT_PS2_Translate);
+DEFINE_STAT(STAT_PS2_GetMeshPayloadData);
+DEFINE_STAT(STAT_PS2_DecodeStrips);
+DEFINE_STAT(STAT_PS2_WeldVertices);
+DEFINE_STAT(STAT_PS2_BuildMeshDescription);
+DEFINE_STAT(STAT_PS2_LoadManifest);
+DEFINE_STAT(STAT_PS2_CollectStaticMeshes);
+DEFINE_STAT(STAT_PS2_ConvertTransforms);
+DEFINE_STAT(STAT_PS2_AssembleLevel);
+DEFINE_STAT(STAT_PS2_PartitionLevel);
+DEFINE_STAT(STAT_PS2_WriteoutLevel);
+DEFINE_STAT(STAT_PS2_SimplifyLOD);
+DEFINE_STAT(STAT_PS2_BuildStrips);
+DEFINE_STAT(STAT_PS2_BatchStaticMeshes);
+
+DEFINE_STAT(STAT_PS2_BytesRead);
+DEFINE_STAT(STAT_PS2_VerticesIn);
+DEFINE_STAT(STAT_PS2_VerticesOut);
+DEFINE_STAT(STAT_PS2_TrianglesIn);
+DEFINE_STAT(STAT_PS2_TrianglesOut);
+DEFINE_STAT(STAT_PS2_DegeneratesDropped);
+DEFINE_STAT(STAT_PS2_PayloadCacheHits);
+DEFINE_STAT(STAT_PS2_InstancesExported);
+DEFINE_STAT(STAT_PS2_AssetLookups);
+DEFINE_STAT(STAT_PS2_BytesWritten);
+DEFINE_STAT(STAT_PS2_MeshesBatched);
 
-		Asset::load_asset_table((std::byte*)AssetManifestBytes.GetData(), FileSize);
-		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Loaded asset manifest succesfully"));
-	}
-	else
-	{
-		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Unable to open asset manifest file: %s"), *AssetManifestPath.FilePath);
-	}
-}
+#define LOCTEXT_NAMESPACE "FPS2LevelEditingToolsModule"
 
 void FPS2LevelEditingToolsModule::StartupModule()
 {
@@ -51,6 +53,10 @@ void FPS2LevelEditingToolsModule::StartupModule()
 
 		//Register the mesh translator
 		InterchangeManager.RegisterTranslator(UInterchangePS2ModelTranslator::StaticClass());
+
+		FPS2AssetReferenceCache::RegisterDelegates();
+		FPS2ActorExportCache::RegisterDelegates();
+		FPS2OperationReport::RegisterDelegates();
 	};
 
 	if (GEngine)
@@ -62,7 +68,7 @@ void FPS2LevelEditingToolsModule::StartupModule()
 		FCoreDelegates::OnPostEngineInit.AddLambda(RegisterItems);
 	}
 
-	LoadManifest();
+	FPS2ManifestLoader::Start();
 
 	FLevelEditorModule& LevelEditorModule = FModuleManager::Get().LoadModuleChecked<FLevelEditorModule>("LevelEditor");
 	auto& MenuExtenders = LevelEditorModule.GetAllLevelViewportContextMenuExtenders();
@@ -73,6 +79,12 @@ void FPS2LevelEditingToolsModule::StartupModule()
 
 void FPS2LevelEditingToolsModule::ShutdownModule()
 {
+	CancelExport();
+	FPS2ManifestLoader::Stop();
+	FPS2AssetReferenceCache::UnregisterDelegates();
+	FPS2ActorExportCache::UnregisterDelegates();
+	FPS2OperationReport::UnregisterDelegates();
+
 	if (LevelViewportExtenderHandle.IsValid())
 	{
 		FLevelEditorModule* LevelEditorModule = FModuleManager::Get().GetModulePtr<FLevelEditorModule>("LevelEditor");
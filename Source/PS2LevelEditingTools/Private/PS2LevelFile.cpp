@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2LevelFile.h"
+#include "Serialization/MemoryWriter.h"
+
+#include "egg/level.hpp"
+
+static_assert(sizeof(UE::Math::TMatrix<float>) == sizeof(Matrix), "Exported transforms are written as egg Matrix");
+static_assert(sizeof(UE::Math::TMatrix<float>) == sizeof(PS2LevelCore::FMatrix44), "Exported transforms are written as egg Matrix");
+static_assert(uint32(EPS2TransformEncoding::Compact) == uint32(PS2LevelCore::ETransformEncoding::Compact), "The file stores EPS2TransformEncoding values");
+
+namespace PS2LevelFile
+{
+	class FArchiveOutput : public PS2LevelCore::ILevelOutput
+	{
+	public:
+		explicit FArchiveOutput(FArchive& InAr)
+			: Ar(InAr)
+		{
+		}
+
+		virtual void Write(const void* Data, size_t Size) override { Ar.Serialize(const_cast<void*>(Data), Size); }
+		virtual int64_t Tell() const override { return Ar.Tell(); }
+		virtual void Seek(int64_t Position) override { Ar.Seek(Position); }
+		virtual bool IsError() const override { return Ar.IsError(); }
+
+	private:
+		FArchive& Ar;
+	};
+
+	static PS2LevelCore::FInstanceGroupsView MakeInstanceGroupsView(const TArray<FPS2InstanceGroup>& Groups, const TArray<UE::Math::TMatrix<float>>& Transforms)
+	{
+		PS2LevelCore::FInstanceGroupsView View;
+		View.Groups = Groups.GetData();
+		View.NumGroups = Groups.Num();
+		View.GroupSize = sizeof(FPS2InstanceGroup);
+		View.Transforms = reinterpret_cast<const PS2LevelCore::FMatrix44*>(Transforms.GetData());
+		View.NumTransforms = Transforms.Num();
+		return View;
+	}
+}
+
+bool SerializePS2Level(const FPS2LevelData& Level, FArchive& Ar, const FPS2LevelWriteOptions& Options, FPS2LevelWriteReport* OutReport, TFunctionRef<bool(float)> Progress)
+{
+	using namespace PS2LevelFile;
+
+	check(Ar.IsSaving());
+
+	std::vector<std::byte> Header;
+	{
+		LevelFileHeader NewLevel;
+		NewLevel.meshes.mesh_files.set((intptr_t)Level.MeshFileReferences.GetData(), Level.MeshFileReferences.Num() * sizeof(Asset::Reference));
+		NewLevel.meshes.mesh_transforms.set((intptr_t)Level.MeshTransforms.GetData(), Level.MeshTransforms.Num() * sizeof(Matrix));
+
+		Serializer s(Header);
+		serialize(s, NewLevel, 1);
+		s.finish_serialization();
+	}
+
+	TArray<PS2LevelCore::FLevelCellView> Cells;
+	Cells.SetNumUninitialized(Level.Cells.Num());
+	for (int32 CellIndex = 0; CellIndex < Level.Cells.Num(); ++CellIndex)
+	{
+		const FPS2LevelCellData& CellData = Level.Cells[CellIndex];
+		PS2LevelCore::FLevelCellView& Cell = Cells[CellIndex];
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			Cell.BoundsMin[Axis] = CellData.Bounds.Min[Axis];
+			Cell.BoundsMax[Axis] = CellData.Bounds.Max[Axis];
+		}
+		Cell.Instances = MakeInstanceGroupsView(CellData.Groups, CellData.Transforms);
+	}
+
+	PS2LevelCore::FLevelView View;
+	View.Header = Header.data();
+	View.HeaderSize = Header.size();
+	View.Instances = MakeInstanceGroupsView(Level.InstanceGroups, Level.InstanceTransforms);
+	View.CellSize = Level.CellSize;
+	View.Cells = Cells.GetData();
+	View.NumCells = Cells.Num();
+
+	PS2LevelCore::FLevelWriteOptions CoreOptions;
+	CoreOptions.TransformEncoding = PS2LevelCore::ETransformEncoding(Options.TransformEncoding);
+	CoreOptions.MaxPositionError = Options.MaxPositionError;
+	CoreOptions.MaxBasisError = Options.MaxBasisError;
+
+	FArchiveOutput Output(Ar);
+	return PS2LevelCore::WriteLevel(View, Output, CoreOptions, OutReport, [&Progress](float Fraction) { return Progress(Fraction); });
+}
+
+TArray<uint8> SerializePS2Level(const FPS2LevelData& Level, const FPS2LevelWriteOptions& Options, FPS2LevelWriteReport* OutReport)
+{
+	TArray<uint8> Out;
+	FMemoryWriter Ar(Out);
+	SerializePS2Level(Level, Ar, Options, OutReport, [](float) { return true; });
+	return Out;
+}
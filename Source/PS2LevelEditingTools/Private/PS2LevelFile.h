@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "Core/PS2LevelCore.h"
+
+#include "egg/math_types.hpp"
+#include "egg/asset.hpp"
+
+/**
+ * A .lvl file is the LevelFileHeader serialized by the egg library followed by an extension block for anything it can't
+ * express. The layout of the extension block is described in Core/PS2LevelCore.h, which writes it.
+ */
+using FPS2InstanceGroup = PS2LevelCore::TInstanceGroup<Asset::Reference>;
+
+/** The meshes in one spatial cell, grouped by mesh. */
+struct FPS2LevelCellData
+{
+	FBox3f Bounds;
+	TArray<FPS2InstanceGroup> Groups;
+	TArray<UE::Math::TMatrix<float>> Transforms;
+};
+
+/** Everything collected from the editor that ends up in a .lvl file. */
+struct FPS2LevelData
+{
+	// Meshes placed individually, written to the LevelFileHeader
+	TArray<UE::Math::TMatrix<float>> MeshTransforms;
+	TArray<Asset::Reference> MeshFileReferences;
+
+	// Instanced meshes, each group's transforms are contiguous in InstanceTransforms
+	TArray<FPS2InstanceGroup> InstanceGroups;
+	TArray<UE::Math::TMatrix<float>> InstanceTransforms;
+
+	// Spatial cells, only used by partitioned levels
+	float CellSize = 0.f;
+	TArray<FPS2LevelCellData> Cells;
+};
+
+struct FPS2LevelWriteOptions
+{
+	EPS2TransformEncoding TransformEncoding = EPS2TransformEncoding::Matrix;
+
+	// Sections with more error than this are stored as matrices even when compact transforms are asked for
+	float MaxPositionError = 0.f;
+	float MaxBasisError = 0.f;
+};
+
+using FPS2LevelWriteReport = PS2LevelCore::FLevelWriteReport;
+
+/**
+ * Writes a level to an archive as a .lvl file. The extension block is written a section at a time. The LevelFileHeader
+ * is serialized in memory in full first, as its layout belongs to the egg serializer, so a level with every mesh in the
+ * header holds all of its references and transforms twice while it's written. Writing the header out is chunked, so it
+ * can be cancelled part way like the sections.
+ *
+ * @param Progress	Called after each chunk of the header and each section with the estimated fraction of the file
+ *					written. Return false to stop writing.
+ * @return False if writing was stopped or the archive failed, in which case the archive holds a partial file.
+ */
+bool SerializePS2Level(const FPS2LevelData& Level, FArchive& Ar, const FPS2LevelWriteOptions& Options, FPS2LevelWriteReport* OutReport, TFunctionRef<bool(float)> Progress);
+
+/** Serializes a level into the bytes of a .lvl file. */
+TArray<uint8> SerializePS2Level(const FPS2LevelData& Level, const FPS2LevelWriteOptions& Options = FPS2LevelWriteOptions(), FPS2LevelWriteReport* OutReport = nullptr);
@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2LevelPartition.h"
+#include "PS2LevelFile.h"
+
+#include "Algo/Unique.h"
+#include "Async/ParallelFor.h"
+
+namespace PS2LevelPartition
+{
+	struct FPlacedMesh
+	{
+		const Asset::Reference* Reference;
+		const UE::Math::TMatrix<float>* Transform;
+		FBox3f Bounds;
+		FIntPoint Cell;
+	};
+}
+
+void PartitionPS2Level(FPS2LevelData& Level, const TPS2AssetReferenceMap<FBox3f>& MeshBounds, float CellSize, bool bParallel)
+{
+	using namespace PS2LevelPartition;
+
+	check(CellSize > 0.f);
+
+	TArray<FPlacedMesh> PlacedMeshes;
+	PlacedMeshes.Reserve(Level.MeshTransforms.Num() + Level.InstanceTransforms.Num());
+	for (int32 Index = 0; Index < Level.MeshTransforms.Num(); ++Index)
+	{
+		PlacedMeshes.Add({ &Level.MeshFileReferences[Index], &Level.MeshTransforms[Index] });
+	}
+	for (const FPS2InstanceGroup& InstanceGroup : Level.InstanceGroups)
+	{
+		for (uint32 Index = 0; Index < InstanceGroup.NumTransforms; ++Index)
+		{
+			PlacedMeshes.Add({ &InstanceGroup.Mesh, &Level.InstanceTransforms[InstanceGroup.FirstTransform + Index] });
+		}
+	}
+
+	ParallelFor(PlacedMeshes.Num(), [&](int32 Index)
+		{
+			FPlacedMesh& PlacedMesh = PlacedMeshes[Index];
+			const FBox3f* LocalBounds = MeshBounds.Find(*PlacedMesh.Reference);
+			if (LocalBounds && LocalBounds->IsValid)
+			{
+				PlacedMesh.Bounds = LocalBounds->TransformBy(*PlacedMesh.Transform);
+			}
+			else
+			{
+				PlacedMesh.Bounds = FBox3f(PlacedMesh.Transform->GetOrigin(), PlacedMesh.Transform->GetOrigin());
+			}
+
+			const FVector3f Center = PlacedMesh.Bounds.GetCenter();
+			PlacedMesh.Cell = FIntPoint(FMath::FloorToInt32(Center.X / CellSize), FMath::FloorToInt32(Center.Z / CellSize));
+		},
+		bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread
+	);
+
+	// Cells are stored row by row so neighbouring cells tend to be close together in the file
+	TArray<FIntPoint> CellKeys;
+	for (const FPlacedMesh& PlacedMesh : PlacedMeshes)
+	{
+		CellKeys.Add(PlacedMesh.Cell);
+	}
+	CellKeys.Sort([](const FIntPoint& A, const FIntPoint& B) { return A.Y != B.Y ? A.Y < B.Y : A.X < B.X; });
+	CellKeys.SetNum(Algo::Unique(CellKeys));
+
+	TMap<FIntPoint, int32> CellIndices;
+	TArray<FPS2LevelCellData> Cells;
+	Cells.SetNum(CellKeys.Num());
+	for (int32 CellIndex = 0; CellIndex < CellKeys.Num(); ++CellIndex)
+	{
+		CellIndices.Add(CellKeys[CellIndex], CellIndex);
+		Cells[CellIndex].Bounds.Init();
+	}
+
+	// Group each cell's meshes the same way foliage is grouped, then fill in the transforms in collection order
+	TArray<int32> MeshGroups;
+	MeshGroups.SetNumUninitialized(PlacedMeshes.Num());
+	{
+		TArray<TPS2AssetReferenceMap<int32>> CellGroupIndices;
+		CellGroupIndices.SetNum(Cells.Num());
+		for (int32 Index = 0; Index < PlacedMeshes.Num(); ++Index)
+		{
+			const FPlacedMesh& PlacedMesh = PlacedMeshes[Index];
+			const int32 CellIndex = CellIndices.FindChecked(PlacedMesh.Cell);
+			FPS2LevelCellData& Cell = Cells[CellIndex];
+
+			int32* GroupIndex = CellGroupIndices[CellIndex].Find(*PlacedMesh.Reference);
+			if (GroupIndex == nullptr)
+			{
+				// Zeroed so the padding written out with the group is deterministic
+				FPS2InstanceGroup& Group = Cell.Groups.AddZeroed_GetRef();
+				Group.Mesh = *PlacedMesh.Reference;
+				GroupIndex = &CellGroupIndices[CellIndex].Add(*PlacedMesh.Reference, Cell.Groups.Num() - 1);
+			}
+
+			MeshGroups[Index] = *GroupIndex;
+			Cell.Groups[*GroupIndex].NumTransforms++;
+			Cell.Bounds += PlacedMesh.Bounds;
+		}
+	}
+
+	for (FPS2LevelCellData& Cell : Cells)
+	{
+		uint32 FirstTransform = 0;
+		for (FPS2InstanceGroup& Group : Cell.Groups)
+		{
+			Group.FirstTransform = FirstTransform;
+			FirstTransform += Group.NumTransforms;
+			Group.NumTransforms = 0;
+		}
+		Cell.Transforms.SetNumUninitialized(FirstTransform);
+	}
+
+	for (int32 Index = 0; Index < PlacedMeshes.Num(); ++Index)
+	{
+		const FPlacedMesh& PlacedMesh = PlacedMeshes[Index];
+		FPS2LevelCellData& Cell = Cells[CellIndices.FindChecked(PlacedMesh.Cell)];
+		FPS2InstanceGroup& Group = Cell.Groups[MeshGroups[Index]];
+		Cell.Transforms[Group.FirstTransform + Group.NumTransforms++] = *PlacedMesh.Transform;
+	}
+
+	// The placed meshes point into these arrays, so they go first
+	PlacedMeshes.Empty();
+	Level.MeshTransforms.Empty();
+	Level.MeshFileReferences.Empty();
+	Level.InstanceGroups.Empty();
+	Level.InstanceTransforms.Empty();
+	Level.CellSize = CellSize;
+	Level.Cells = MoveTemp(Cells);
+}
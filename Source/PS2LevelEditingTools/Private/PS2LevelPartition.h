@@ -0,0 +1,17 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PS2AssetIndex.h"
+
+struct FPS2LevelData;
+
+/**
+ * Moves every mesh of a level into a grid of square cells on the ground plane (PS2 X and Z, Y is up). A mesh goes in
+ * the cell holding the center of its level space bounds, and each cell's bounds cover all of its meshes.
+ *
+ * @param MeshBounds	Local bounds of each exported mesh, in the PS2 basis. Meshes without bounds are treated as a point.
+ * @param CellSize		Width of a cell in level units.
+ */
+void PartitionPS2Level(FPS2LevelData& Level, const TPS2AssetReferenceMap<FBox3f>& MeshBounds, float CellSize, bool bParallel);
@@ -0,0 +1,232 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2ManifestLoader.h"
+#include "PS2AssetIndex.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingStats.h"
+#include "PS2LevelEditingTools.h"
+#include "Async/Async.h"
+#include "Containers/Ticker.h"
+#include "DirectoryWatcherModule.h"
+#include "IDirectoryWatcher.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+
+#include "egg/asset.hpp"
+
+namespace PS2ManifestLoader
+{
+	// The pipeline writes the manifest in several steps, wait for it to settle before loading
+	constexpr float ReloadDelay = 0.5f;
+
+	// Loads into the asset table are one at a time, from whichever worker runs them
+	static FCriticalSection LoadLock;
+
+	static TFuture<void> PendingLoad;
+	static bool bLoadRequested = false;
+
+	static FString WatchedDirectory;
+	static FDelegateHandle DirectoryWatcherHandle;
+	static FTSTicker::FDelegateHandle ReloadTickerHandle;
+	static FDelegateHandle SettingsChangedHandle;
+
+	static FString GetManifestPath()
+	{
+		return FPaths::ConvertRelativePathToFull(UPS2LevelEditingDeveloperSettings::Get()->ManifestPath.FilePath);
+	}
+
+	static void LoadManifest(const FString& ManifestPath)
+	{
+		// Loads aren't part of an import or export, they only show up in Insights and the stat group
+		PS2_SCOPE_PHASE(nullptr, LoadManifest);
+
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+		const int64 FileSize = PlatformFile.FileSize(*ManifestPath);
+		if (FileSize < 0)
+		{
+			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Unable to open asset manifest file: %s"), *ManifestPath);
+			return;
+		}
+
+		const int64 ExpectedManifestSize = sizeof(Asset::AssetHashMapT);
+		if (FileSize != ExpectedManifestSize)
+		{
+			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Asset manifest file size mismatch! File size: %lld, Expected size: %lld"), FileSize, ExpectedManifestSize);
+			return;
+		}
+
+		TUniquePtr<IMappedFileHandle> MappedFile(PlatformFile.OpenMapped(*ManifestPath));
+		TUniquePtr<IMappedFileRegion> MappedRegion(MappedFile.IsValid() ? MappedFile->MapRegion(0, FileSize) : nullptr);
+
+		TArray64<uint8> AssetManifestBytes;
+		const uint8* AssetManifestData = nullptr;
+		if (MappedRegion.IsValid() && MappedRegion->GetMappedSize() == FileSize)
+		{
+			AssetManifestData = MappedRegion->GetMappedPtr();
+		}
+		else
+		{
+			// Not every platform file supports mapping, fall back to reading the whole file
+			if (!FFileHelper::LoadFileToArray(AssetManifestBytes, *ManifestPath) || AssetManifestBytes.Num() != ExpectedManifestSize)
+			{
+				UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Unable to read asset manifest file: %s"), *ManifestPath);
+				return;
+			}
+			AssetManifestData = AssetManifestBytes.GetData();
+		}
+
+		PS2_ADD_COUNTER(nullptr, BytesRead, FileSize);
+
+		FScopeLock Lock(&LoadLock);
+
+		// The index is only swapped once it's been rebuilt from the new table, lookups see the old or new one as a whole
+		Asset::load_asset_table((std::byte*)AssetManifestData, FileSize);
+		FPS2AssetIndex::Rebuild();
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Loaded asset manifest succesfully, %d assets"), FPS2AssetIndex::Num());
+	}
+
+	static void StartLoad()
+	{
+		bLoadRequested = false;
+		PendingLoad = Async(EAsyncExecution::ThreadPool, [ManifestPath = GetManifestPath()]()
+			{
+				LoadManifest(ManifestPath);
+			},
+			[]()
+			{
+				// Runs once the future is ready, picks up a change that came in while this was loading
+				AsyncTask(ENamedThreads::GameThread, []()
+					{
+						if (bLoadRequested)
+						{
+							StartLoad();
+						}
+					}
+				);
+			}
+		);
+	}
+
+	static IDirectoryWatcher* GetDirectoryWatcher()
+	{
+		FDirectoryWatcherModule& DirectoryWatcherModule = FModuleManager::LoadModuleChecked<FDirectoryWatcherModule>(TEXT("DirectoryWatcher"));
+		return DirectoryWatcherModule.Get();
+	}
+
+	static void OnDirectoryChanged(const TArray<FFileChangeData>& Changes)
+	{
+		const FString ManifestPath = GetManifestPath();
+		const bool bManifestChanged = Changes.ContainsByPredicate([&ManifestPath](const FFileChangeData& Change)
+			{
+				return FPaths::IsSamePath(FPaths::ConvertRelativePathToFull(Change.Filename), ManifestPath);
+			}
+		);
+		if (!bManifestChanged)
+		{
+			return;
+		}
+
+		// Restart the delay on every change so the load happens once the writes stop
+		FTSTicker::GetCoreTicker().RemoveTicker(ReloadTickerHandle);
+		ReloadTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([](float)
+			{
+				ReloadTickerHandle.Reset();
+				UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Asset manifest changed, reloading"));
+				FPS2ManifestLoader::RequestLoad();
+				return false;
+			}
+		), ReloadDelay);
+	}
+
+	static void WatchManifestDirectory()
+	{
+		IDirectoryWatcher* DirectoryWatcher = GetDirectoryWatcher();
+		if (DirectoryWatcher == nullptr)
+		{
+			return;
+		}
+
+		if (DirectoryWatcherHandle.IsValid())
+		{
+			DirectoryWatcher->UnregisterDirectoryChangedCallback_Handle(WatchedDirectory, DirectoryWatcherHandle);
+			DirectoryWatcherHandle.Reset();
+		}
+
+		WatchedDirectory = FPaths::GetPath(GetManifestPath());
+		if (!WatchedDirectory.IsEmpty() && FPaths::DirectoryExists(WatchedDirectory))
+		{
+			DirectoryWatcher->RegisterDirectoryChangedCallback_Handle(WatchedDirectory, IDirectoryWatcher::FDirectoryChanged::CreateStatic(&OnDirectoryChanged), DirectoryWatcherHandle);
+		}
+	}
+}
+
+void FPS2ManifestLoader::Start()
+{
+	using namespace PS2ManifestLoader;
+
+	check(IsInGameThread());
+
+	StartLoad();
+	WatchManifestDirectory();
+
+	SettingsChangedHandle = UPS2LevelEditingDeveloperSettings::Get()->OnSettingChanged().AddLambda([](UObject*, FPropertyChangedEvent& PropertyChangedEvent)
+		{
+			if (PropertyChangedEvent.GetMemberPropertyName() == GET_MEMBER_NAME_CHECKED(UPS2LevelEditingDeveloperSettings, ManifestPath))
+			{
+				WatchManifestDirectory();
+				FPS2ManifestLoader::RequestLoad();
+			}
+		}
+	);
+}
+
+void FPS2ManifestLoader::Stop()
+{
+	using namespace PS2ManifestLoader;
+
+	check(IsInGameThread());
+
+	if (UObjectInitialized() && SettingsChangedHandle.IsValid())
+	{
+		UPS2LevelEditingDeveloperSettings::Get()->OnSettingChanged().Remove(SettingsChangedHandle);
+	}
+	SettingsChangedHandle.Reset();
+
+	FTSTicker::GetCoreTicker().RemoveTicker(ReloadTickerHandle);
+	ReloadTickerHandle.Reset();
+
+	if (DirectoryWatcherHandle.IsValid())
+	{
+		if (FDirectoryWatcherModule* DirectoryWatcherModule = FModuleManager::GetModulePtr<FDirectoryWatcherModule>(TEXT("DirectoryWatcher")))
+		{
+			if (IDirectoryWatcher* DirectoryWatcher = DirectoryWatcherModule->Get())
+			{
+				DirectoryWatcher->UnregisterDirectoryChangedCallback_Handle(WatchedDirectory, DirectoryWatcherHandle);
+			}
+		}
+	}
+	DirectoryWatcherHandle.Reset();
+
+	bLoadRequested = false;
+	if (PendingLoad.IsValid())
+	{
+		PendingLoad.Wait();
+	}
+}
+
+void FPS2ManifestLoader::RequestLoad()
+{
+	using namespace PS2ManifestLoader;
+
+	check(IsInGameThread());
+
+	if (PendingLoad.IsValid() && !PendingLoad.IsReady())
+	{
+		bLoadRequested = true;
+		return;
+	}
+
+	StartLoad();
+}
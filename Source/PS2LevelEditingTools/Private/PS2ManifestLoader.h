@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Loads the PS2 asset manifest into the asset table on a worker thread, so editor startup doesn't wait for it, and
+ * loads it again whenever the PS2 build pipeline rewrites it or the manifest path setting changes. The file is mapped
+ * rather than read into a buffer. A manifest that fails to load leaves the previous table in place.
+ *
+ * Game thread only.
+ */
+class FPS2ManifestLoader
+{
+public:
+	/** Starts the first load and watches the manifest directory. */
+	static void Start();
+
+	/** Stops watching and waits for a load in progress to finish. */
+	static void Stop();
+
+	/** Loads the manifest again, after the one in progress if there is one. */
+	static void RequestLoad();
+};
@@ -0,0 +1,168 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2MeshFile.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Hash/xxhash.h"
+#include "Misc/FileHelper.h"
+#include "PS2LevelEditingTools.h"
+
+#include "egg/mesh_header.hpp"
+
+namespace PS2MeshFile
+{
+	// Files that are still referenced by a translator or payload task, keyed by filename
+	static FCriticalSection OpenFilesLock;
+	static TMap<FString, TWeakPtr<const FPS2MeshFile, ESPMode::ThreadSafe>> OpenFiles;
+}
+
+FPS2MeshFile::~FPS2MeshFile()
+{
+	// The region has to be unmapped before the file handle is closed
+	MappedRegion.Reset();
+	MappedFile.Reset();
+
+	if (!Filename.IsEmpty())
+	{
+		FScopeLock Lock(&PS2MeshFile::OpenFilesLock);
+
+		// Only forget the entry if it still refers to this file, a newer version may have been opened since
+		const TWeakPtr<const FPS2MeshFile, ESPMode::ThreadSafe>* OpenFile = PS2MeshFile::OpenFiles.Find(Filename);
+		if (OpenFile && !OpenFile->IsValid())
+		{
+			PS2MeshFile::OpenFiles.Remove(Filename);
+		}
+	}
+}
+
+FPS2MeshFilePtr FPS2MeshFile::Open(const FString& Filename)
+{
+	const FDateTime TimeStamp = IFileManager::Get().GetTimeStamp(*Filename);
+	const int64 FileSize = IFileManager::Get().FileSize(*Filename);
+
+	{
+		FScopeLock Lock(&PS2MeshFile::OpenFilesLock);
+		if (const TWeakPtr<const FPS2MeshFile, ESPMode::ThreadSafe>* OpenFile = PS2MeshFile::OpenFiles.Find(Filename))
+		{
+			FPS2MeshFilePtr File = OpenFile->Pin();
+			if (File.IsValid() && File->TimeStamp == TimeStamp && File->Size == FileSize)
+			{
+				return File;
+			}
+		}
+	}
+
+	// Open outside of the lock so different files can be opened in parallel
+	TSharedPtr<FPS2MeshFile, ESPMode::ThreadSafe> File = MakeShareable(new FPS2MeshFile());
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	File->MappedFile.Reset(PlatformFile.OpenMapped(*Filename));
+	if (File->MappedFile.IsValid() && File->MappedFile->GetFileSize() > 0)
+	{
+		File->MappedRegion.Reset(File->MappedFile->MapRegion(0, File->MappedFile->GetFileSize()));
+	}
+
+	if (File->MappedRegion.IsValid())
+	{
+		File->Data = File->MappedRegion->GetMappedPtr();
+		File->Size = File->MappedRegion->GetMappedSize();
+	}
+	else
+	{
+		// Not every platform file supports mapping, fall back to reading the whole file
+		File->MappedFile.Reset();
+		if (!FFileHelper::LoadFileToArray(File->FileData, *Filename))
+		{
+			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Unable to read model file: %s"), *Filename);
+			return nullptr;
+		}
+
+		File->Data = File->FileData.GetData();
+		File->Size = File->FileData.Num();
+	}
+
+	if (!Validate(File->Data, File->Size, Filename))
+	{
+		return nullptr;
+	}
+
+	File->Filename = Filename;
+	File->TimeStamp = TimeStamp;
+
+	FScopeLock Lock(&PS2MeshFile::OpenFilesLock);
+
+	// Another thread may have opened the same file in the meantime, share theirs so only one copy stays around
+	TWeakPtr<const FPS2MeshFile, ESPMode::ThreadSafe>& OpenFile = PS2MeshFile::OpenFiles.FindOrAdd(Filename);
+	FPS2MeshFilePtr Existing = OpenFile.Pin();
+	if (Existing.IsValid() && Existing->TimeStamp == TimeStamp && Existing->Size == File->Size)
+	{
+		return Existing;
+	}
+
+	OpenFile = File;
+	return File;
+}
+
+uint64 FPS2MeshFile::GetContentHash() const
+{
+	std::call_once(ContentHashOnce, [this]()
+		{
+			ContentHash = FXxHash64::HashBuffer(Data, Size).Hash;
+		}
+	);
+	return ContentHash;
+}
+
+template<typename ArrayType>
+static bool IsArrayInFile(const ArrayType& Array, const uint8* Data, int64 Size)
+{
+	using ElementType = std::remove_cv_t<std::remove_reference_t<decltype(Array[0])>>;
+
+	const uint64 NumElements = Array.num_elements();
+	if (NumElements == 0)
+	{
+		return true;
+	}
+
+	// The arrays are stored as offsets relative to the header, so only compare addresses here. Nothing is read until the range is known to be valid
+	const UPTRINT Begin = reinterpret_cast<UPTRINT>(Data);
+	const UPTRINT End = Begin + Size;
+	const UPTRINT First = reinterpret_cast<UPTRINT>(&Array[0]);
+
+	if (First < Begin || First >= End || (First % alignof(ElementType)) != 0)
+	{
+		return false;
+	}
+
+	return NumElements <= (End - First) / sizeof(ElementType);
+}
+
+bool FPS2MeshFile::Validate(const uint8* Data, int64 Size, const FString& Filename)
+{
+	if (Data == nullptr || Size < (int64)sizeof(MeshFileHeader))
+	{
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Model file is too small to hold a header: %s"), *Filename);
+		return false;
+	}
+
+	const MeshFileHeader& Header = *reinterpret_cast<const MeshFileHeader*>(Data);
+	if (!IsArrayInFile(Header.pos, Data, Size) ||
+		!IsArrayInFile(Header.nrm, Data, Size) ||
+		!IsArrayInFile(Header.uvs, Data, Size) ||
+		!IsArrayInFile(Header.colors, Data, Size))
+	{
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Model file has vertex data outside of the file: %s"), *Filename);
+		return false;
+	}
+
+	// Every attribute is indexed by strip entry
+	const uint64 NumVertices = Header.pos.num_elements();
+	if (Header.nrm.num_elements() < NumVertices || Header.uvs.num_elements() < NumVertices || Header.colors.num_elements() < NumVertices)
+	{
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Model file has fewer normals, uvs or colors than positions: %s"), *Filename);
+		return false;
+	}
+
+	return true;
+}
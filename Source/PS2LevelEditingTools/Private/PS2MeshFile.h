@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/MappedFileHandle.h"
+
+#include <mutex>
+
+struct MeshFileHeader;
+
+using FPS2MeshFilePtr = TSharedPtr<const class FPS2MeshFile, ESPMode::ThreadSafe>;
+
+/**
+ * A .mdl file opened for reading. The file is memory mapped where the platform supports it so the header and
+ * vertex arrays are read in place, otherwise the whole file is loaded into memory.
+ *
+ * Opened files are immutable and shared. Every translator and payload task importing the same unchanged file
+ * references the same instance, so they can run concurrently without reading the file again.
+ */
+class FPS2MeshFile
+{
+public:
+	~FPS2MeshFile();
+
+	/**
+	 * Opens a .mdl file and validates its header. Returns the already opened instance if the file is still
+	 * referenced and hasn't changed on disk since. Safe to call from any thread.
+	 *
+	 * @param Filename - The .mdl file to open.
+	 * @return The opened file, or null if it couldn't be read or its header points outside of the file.
+	 */
+	static FPS2MeshFilePtr Open(const FString& Filename);
+
+	const MeshFileHeader& GetHeader() const { return *reinterpret_cast<const MeshFileHeader*>(Data); }
+
+	/** The whole file as it is on disk. */
+	TConstArrayView64<uint8> GetBytes() const { return TConstArrayView64<uint8>(Data, Size); }
+
+	/**
+	 * xxHash64 of the whole file. Computed the first time it's asked for and shared by every section and LOD payload
+	 * of the file after that.
+	 */
+	uint64 GetContentHash() const;
+
+	const FString& GetFilename() const { return Filename; }
+	int64 GetSize() const { return Size; }
+	bool IsMapped() const { return MappedRegion.IsValid(); }
+
+private:
+	FPS2MeshFile() = default;
+
+	// Checks that every array in the header lies within the file before anything dereferences it
+	static bool Validate(const uint8* Data, int64 Size, const FString& Filename);
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	TArray64<uint8> FileData;
+
+	const uint8* Data = nullptr;
+	int64 Size = 0;
+
+	FString Filename;
+	FDateTime TimeStamp;
+
+	mutable std::once_flag ContentHashOnce;
+	mutable uint64 ContentHash = 0;
+};
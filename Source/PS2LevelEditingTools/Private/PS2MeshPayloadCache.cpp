@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2MeshPayloadCache.h"
+#include "PS2MeshFile.h"
+#include "DerivedDataCacheInterface.h"
+#include "Hash/xxhash.h"
+#include "MeshDescription.h"
+#include "Serialization/CustomVersion.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace PS2MeshPayloadCache
+{
+	// Change whenever the payload built from the same file and settings changes, to stop old entries being used
+	static const TCHAR* Version = TEXT("E27B5D90C4A1483F8B6D2E7C19F0A543");
+}
+
+FString FPS2MeshPayloadCache::MakeKey(const FPS2MeshFile& MeshFile, const FTransform& MeshGlobalTransform, const FString& SettingsKey)
+{
+	const FMatrix Transform = MeshGlobalTransform.ToMatrixWithScale();
+	const FXxHash64 TransformHash = FXxHash64::HashBuffer(&Transform.M[0][0], sizeof(Transform.M));
+
+	const FString Suffix = FString::Printf(TEXT("%016llx_%lld_%016llx_%s"), MeshFile.GetContentHash(), MeshFile.GetSize(), TransformHash.Hash, *SettingsKey);
+	return FDerivedDataCacheInterface::BuildCacheKey(TEXT("PS2MDL"), PS2MeshPayloadCache::Version, *Suffix);
+}
+
+bool FPS2MeshPayloadCache::Load(const FString& Key, FMeshDescription& OutMeshDescription, float& OutLODError)
+{
+	TArray<uint8> Data;
+	if (!GetDerivedDataCacheRef().GetSynchronous(*Key, Data, TEXT("PS2 model payload")))
+	{
+		return false;
+	}
+
+	// The mesh description is stored with the custom versions it was written with
+	FMemoryReader Reader(Data, /*bIsPersistent*/ true);
+	FCustomVersionContainer CustomVersions;
+	CustomVersions.Serialize(Reader);
+	TArray<uint8> MeshDescriptionData;
+	Reader << MeshDescriptionData;
+	float LODError = 0.f;
+	Reader << LODError;
+	if (Reader.IsError())
+	{
+		return false;
+	}
+
+	FMeshDescription MeshDescription;
+	FMemoryReader MeshDescriptionReader(MeshDescriptionData, /*bIsPersistent*/ true);
+	MeshDescriptionReader.SetCustomVersions(CustomVersions);
+	MeshDescription.Serialize(MeshDescriptionReader);
+	if (MeshDescriptionReader.IsError())
+	{
+		return false;
+	}
+
+	OutMeshDescription = MoveTemp(MeshDescription);
+	OutLODError = LODError;
+	return true;
+}
+
+void FPS2MeshPayloadCache::Store(const FString& Key, const FMeshDescription& MeshDescription, float LODError)
+{
+	TArray<uint8> MeshDescriptionData;
+	FMemoryWriter MeshDescriptionWriter(MeshDescriptionData, /*bIsPersistent*/ true);
+	const_cast<FMeshDescription&>(MeshDescription).Serialize(MeshDescriptionWriter);
+
+	TArray<uint8> Data;
+	FMemoryWriter Writer(Data, /*bIsPersistent*/ true);
+	FCustomVersionContainer CustomVersions = MeshDescriptionWriter.GetCustomVersions();
+	CustomVersions.Serialize(Writer);
+	Writer << MeshDescriptionData;
+	Writer << LODError;
+
+	GetDerivedDataCacheRef().Put(*Key, Data, TEXT("PS2 model payload"));
+}
@@ -0,0 +1,36 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FPS2MeshFile;
+struct FMeshDescription;
+
+/**
+ * Keeps built .mdl mesh descriptions in the derived data cache, so reimporting a file whose contents haven't changed
+ * is a cache read instead of a rebuild. Entries are keyed on the file contents rather than its name or timestamp, which
+ * makes files the PS2 pipeline rewrote without changing hit the cache as well.
+ *
+ * Safe to call from any thread.
+ */
+class FPS2MeshPayloadCache
+{
+public:
+	/**
+	 * @param SettingsKey - Every setting that changes the built mesh description, as a string.
+	 */
+	static FString MakeKey(const FPS2MeshFile& MeshFile, const FTransform& MeshGlobalTransform, const FString& SettingsKey);
+
+	/**
+	 * Returns false if there's no entry for the key or it couldn't be read, in which case the outputs are unchanged.
+	 *
+	 * @param OutLODError - The simplification error stored with the mesh description.
+	 */
+	static bool Load(const FString& Key, FMeshDescription& OutMeshDescription, float& OutLODError);
+
+	/**
+	 * @param LODError - Simplification error of a generated LOD in model units, 0 for LOD0.
+	 */
+	static void Store(const FString& Key, const FMeshDescription& MeshDescription, float LODError);
+};
@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2MeshSections.h"
+#include "PS2LevelEditingTools.h"
+#include "PS2MeshFile.h"
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+
+#include "egg/mesh_header.hpp"
+
+static bool ParsePS2MeshSections(const FString& Json, int64 NumFileVertices, FName DefaultMaterialSlotName, TArray<FPS2MeshSection>& OutSections)
+{
+	TSharedPtr<FJsonObject> Root;
+	if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Json), Root) || !Root.IsValid())
+	{
+		return false;
+	}
+
+	const TArray<TSharedPtr<FJsonValue>>* Sections = nullptr;
+	if (!Root->TryGetArrayField(TEXT("Sections"), Sections) || Sections->Num() == 0)
+	{
+		return false;
+	}
+
+	for (const TSharedPtr<FJsonValue>& Value : *Sections)
+	{
+		const TSharedPtr<FJsonObject>* Object = nullptr;
+		if (!Value->TryGetObject(Object))
+		{
+			return false;
+		}
+
+		int64 FirstVertex = 0;
+		int64 NumVertices = 0;
+		if (!(*Object)->TryGetNumberField(TEXT("FirstVertex"), FirstVertex) || !(*Object)->TryGetNumberField(TEXT("NumVertices"), NumVertices))
+		{
+			return false;
+		}
+		if (FirstVertex < 0 || NumVertices < 0 || FirstVertex + NumVertices > NumFileVertices)
+		{
+			return false;
+		}
+
+		FString Material;
+		(*Object)->TryGetStringField(TEXT("Material"), Material);
+
+		FPS2MeshSection& Section = OutSections.AddDefaulted_GetRef();
+		Section.FirstVertex = int32(FirstVertex);
+		Section.NumVertices = int32(NumVertices);
+		Section.MaterialSlotName = Material.IsEmpty() ? DefaultMaterialSlotName : FName(Material);
+	}
+
+	return true;
+}
+
+bool SavePS2MeshSections(const FString& ModelFilename, TConstArrayView<FPS2MeshSection> Sections)
+{
+	const FString SectionsPath = GetPS2MeshSectionsPath(ModelFilename);
+	if (Sections.Num() <= 1)
+	{
+		return IFileManager::Get().Delete(*SectionsPath, false, false, true) || !FPaths::FileExists(SectionsPath);
+	}
+
+	TArray<TSharedPtr<FJsonValue>> SectionValues;
+	for (const FPS2MeshSection& Section : Sections)
+	{
+		TSharedRef<FJsonObject> Object = MakeShared<FJsonObject>();
+		Object->SetNumberField(TEXT("FirstVertex"), Section.FirstVertex);
+		Object->SetNumberField(TEXT("NumVertices"), Section.NumVertices);
+		Object->SetStringField(TEXT("Material"), Section.MaterialSlotName.ToString());
+		SectionValues.Add(MakeShared<FJsonValueObject>(Object));
+	}
+
+	TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+	Root->SetArrayField(TEXT("Sections"), SectionValues);
+
+	FString Json;
+	FJsonSerializer::Serialize(Root, TJsonWriterFactory<>::Create(&Json));
+	return FFileHelper::SaveStringToFile(Json, *SectionsPath);
+}
+
+FString GetPS2MeshSectionsPath(const FString& ModelFilename)
+{
+	return FPaths::SetExtension(ModelFilename, TEXT("sections.json"));
+}
+
+void LoadPS2MeshSections(const FPS2MeshFile& MeshFile, FName DefaultMaterialSlotName, TArray<FPS2MeshSection>& OutSections)
+{
+	const int64 NumFileVertices = MeshFile.GetHeader().pos.num_elements();
+
+	OutSections.Reset();
+
+	const FString SectionsPath = GetPS2MeshSectionsPath(MeshFile.GetFilename());
+	FString Json;
+	if (FPaths::FileExists(SectionsPath) && FFileHelper::LoadFileToString(Json, *SectionsPath))
+	{
+		if (ParsePS2MeshSections(Json, NumFileVertices, DefaultMaterialSlotName, OutSections))
+		{
+			return;
+		}
+
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Ignoring model sections that aren't valid or don't fit the model, importing it as one section: %s"), *SectionsPath);
+		OutSections.Reset();
+	}
+
+	FPS2MeshSection& Section = OutSections.AddDefaulted_GetRef();
+	Section.FirstVertex = 0;
+	Section.NumVertices = int32(NumFileVertices);
+	Section.MaterialSlotName = DefaultMaterialSlotName;
+}
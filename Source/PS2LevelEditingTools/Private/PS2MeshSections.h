@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FPS2MeshFile;
+
+/** A run of strip entries in a .mdl file drawn with one texture. Each material slot gets its own polygon group. */
+struct FPS2MeshSection
+{
+	int32 FirstVertex = 0;
+	int32 NumVertices = 0;
+
+	/** Material slot the section's polygon group is bound to. */
+	FName MaterialSlotName;
+};
+
+/**
+ * The sections of a .mdl file. MeshFileHeader has no room for per texture batches, so the PS2 pipeline lists them in a
+ * sidecar next to the model, <model>.sections.json:
+ *
+ *	{ "Sections": [ { "FirstVertex": 0, "NumVertices": 1200, "Material": "Rock" }, ... ] }
+ *
+ * Strips don't run across sections, the stitching between two sections is dropped. Strip entries outside of every
+ * section aren't imported. A model without a sidecar, or with one that can't be used, is a single section covering the
+ * whole file bound to DefaultMaterialSlotName.
+ *
+ * Safe to call from any thread.
+ */
+void LoadPS2MeshSections(const FPS2MeshFile& MeshFile, FName DefaultMaterialSlotName, TArray<FPS2MeshSection>& OutSections);
+
+/**
+ * Writes the sidecar for a .mdl file, or deletes it if there's only one section so a stale one isn't picked up.
+ *
+ * @return False if the sidecar couldn't be written or deleted.
+ */
+bool SavePS2MeshSections(const FString& ModelFilename, TConstArrayView<FPS2MeshSection> Sections);
+
+/** Path of the sidecar listing the sections of a .mdl file. */
+FString GetPS2MeshSectionsPath(const FString& ModelFilename);
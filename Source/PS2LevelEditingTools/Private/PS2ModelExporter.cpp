@@ -0,0 +1,322 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2ModelExporter.h"
+#include "Engine/StaticMesh.h"
+#include "MeshDescription.h"
+#include "Misc/FileHelper.h"
+#include "StaticMeshAttributes.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingStats.h"
+#include "PS2LevelEditingTools.h"
+#include "PS2MeshSections.h"
+#include "PS2ModelWriter.h"
+#include "Core/PS2MeshCore.h"
+
+#include "egg/mesh_header.hpp"
+
+static_assert(sizeof(FVector4f) == sizeof(Vector), "Positions, normals and colors are written as egg Vector");
+static_assert(sizeof(FVector2f) == sizeof(Vector2), "UVs are written as egg Vector2");
+
+namespace PS2ModelExporter
+{
+	// Position, normal, UV and color are each unpacked to a qword
+	constexpr int32 QwordsPerVertex = 4;
+
+	// Most vertices one VIF UNPACK can write
+	constexpr int32 MaxUnpackVertices = 256;
+
+	// A mesh description corner in the file's basis. Vertices are compared bytewise when welding, zero initialize them
+	struct FVertex
+	{
+		FVector4f Position;
+		FVector4f Normal;
+		FVector2f UV;
+		FVector4f Color;
+	};
+
+	// The arrays of one .mdl file
+	struct FModel
+	{
+		TArray<FVector4f> Positions;
+		TArray<FVector4f> Normals;
+		TArray<FVector2f> UVs;
+		TArray<FVector4f> Colors;
+		TArray<FPS2MeshSection> Sections;
+	};
+
+	struct FModelStats
+	{
+		int32 NumTriangles = 0;
+		int32 NumWeldedVertices = 0;
+		PS2MeshCore::FStripBuildStats Strips;
+	};
+
+	static int32 GetBatchSize(const UPS2LevelEditingDeveloperSettings& Settings)
+	{
+		const int32 NumVertices = FMath::Min((Settings.VU1BatchBufferQwords - Settings.VU1BatchHeaderQwords) / QwordsPerVertex, MaxUnpackVertices);
+		return FMath::Max(NumVertices & ~1, 8);
+	}
+
+	// Gathers the triangles of one polygon group, converted from UE's basis and linear colors to the file's. The inverse
+	// of what the translator does on import
+	static void CollectSection(const FMeshDescription& MeshDescription, FPolygonGroupID PolygonGroup, const PS2MeshCore::FColorLinearizer& ColorCurve, bool bConvertAlpha,
+		TArray<FVertex>& OutVertices, TArray<uint32>& OutIndices)
+	{
+		FStaticMeshConstAttributes Attributes(MeshDescription);
+		TVertexAttributesConstRef<FVector3f> Positions = Attributes.GetVertexPositions();
+		TVertexInstanceAttributesConstRef<FVector3f> Normals = Attributes.GetVertexInstanceNormals();
+		TVertexInstanceAttributesConstRef<FVector2f> UVs = Attributes.GetVertexInstanceUVs();
+		TVertexInstanceAttributesConstRef<FVector4f> Colors = Attributes.GetVertexInstanceColors();
+		const bool bHasUVs = UVs.IsValid() && UVs.GetNumChannels() > 0;
+
+		const TArrayView<const FTriangleID> Triangles = MeshDescription.GetPolygonGroupTriangles(PolygonGroup);
+		OutVertices.Reset();
+		OutVertices.SetNumZeroed(Triangles.Num() * 3);
+		OutIndices.SetNumUninitialized(Triangles.Num() * 3);
+
+		int32 Corner = 0;
+		for (const FTriangleID Triangle : Triangles)
+		{
+			for (const FVertexInstanceID VertexInstance : MeshDescription.GetTriangleVertexInstances(Triangle))
+			{
+				const FVector3f Position = Positions[MeshDescription.GetVertexInstanceVertex(VertexInstance)];
+				const FVector3f Normal = Normals.IsValid() ? Normals[VertexInstance] : FVector3f::ZeroVector;
+				const FVector4f Color = Colors.IsValid() ? Colors[VertexInstance] : FVector4f(1.f, 1.f, 1.f, 1.f);
+
+				FVertex& Vertex = OutVertices[Corner];
+				Vertex.Position = FVector4f(Position.X, Position.Z, Position.Y, 1.f);
+				Vertex.Normal = FVector4f(Normal.X, -Normal.Z, Normal.Y, 0.f);
+				Vertex.UV = bHasUVs ? UVs.Get(VertexInstance, 0) : FVector2f::ZeroVector;
+				Vertex.Color = FVector4f(ColorCurve.Linearize(Color.X), ColorCurve.Linearize(Color.Y), ColorCurve.Linearize(Color.Z), bConvertAlpha ? ColorCurve.Linearize(Color.W) : Color.W);
+
+				OutIndices[Corner] = Corner;
+				++Corner;
+			}
+		}
+	}
+
+	static void BuildModel(const FMeshDescription& MeshDescription, const UPS2LevelEditingDeveloperSettings& Settings, FPS2OperationReport& Report, FModel& OutModel, FModelStats& OutStats)
+	{
+		const PS2MeshCore::FColorLinearizer ColorCurve(1.f / Settings.VertexColorGamma);
+		const PS2MeshCore::EStripRestartMode RestartMode = PS2MeshCore::EStripRestartMode(Settings.StripRestartMode);
+		const int32 BatchSize = GetBatchSize(Settings);
+
+		FStaticMeshConstAttributes Attributes(MeshDescription);
+		TPolygonGroupAttributesConstRef<FName> MaterialSlotNames = Attributes.GetPolygonGroupMaterialSlotNames();
+
+		TArray<FVertex> Vertices;
+		TArray<uint32> Indices;
+		std::vector<PS2MeshCore::FStripEntry> Entries;
+		for (const FPolygonGroupID PolygonGroup : MeshDescription.PolygonGroups().GetElementIDs())
+		{
+			CollectSection(MeshDescription, PolygonGroup, ColorCurve, Settings.bLinearizeVertexAlpha, Vertices, Indices);
+			if (Indices.Num() == 0)
+			{
+				continue;
+			}
+			OutStats.NumTriangles += Indices.Num() / 3;
+
+			Vertices.SetNum(PS2MeshCore::WeldVertices(Vertices.GetData(), Vertices.Num(), sizeof(FVertex), Indices.GetData(), Indices.Num()), false);
+			OutStats.NumWeldedVertices += Vertices.Num();
+
+			PS2MeshCore::FStripBuildStats StripStats;
+			{
+				PS2_SCOPE_PHASE(&Report, BuildStrips);
+				PS2MeshCore::BuildStrips(Indices.GetData(), Indices.Num(), Vertices.Num(), RestartMode, BatchSize, Entries, &StripStats);
+			}
+
+			// Every section starts a batch, the runtime switches textures between them. The previous section is padded
+			// with repeats of its last entry, which only make triangles with no area
+			if (OutModel.Sections.Num() > 0)
+			{
+				const int32 NumPadding = (BatchSize - OutModel.Positions.Num() % BatchSize) % BatchSize;
+				for (int32 Padding = 0; Padding < NumPadding; ++Padding)
+				{
+					OutModel.Positions.Add(OutModel.Positions.Last());
+					OutModel.Normals.Add(OutModel.Normals.Last());
+					OutModel.UVs.Add(OutModel.UVs.Last());
+					OutModel.Colors.Add(OutModel.Colors.Last());
+				}
+				OutModel.Sections.Last().NumVertices += NumPadding;
+				OutStats.Strips.NumEntries += NumPadding;
+				OutStats.Strips.NumExtraEntries += NumPadding;
+			}
+
+			FPS2MeshSection& Section = OutModel.Sections.AddDefaulted_GetRef();
+			Section.FirstVertex = OutModel.Positions.Num();
+			Section.NumVertices = int32(Entries.size());
+			Section.MaterialSlotName = MaterialSlotNames[PolygonGroup];
+
+			for (const PS2MeshCore::FStripEntry& Entry : Entries)
+			{
+				const FVertex& Vertex = Vertices[Entry.Vertex];
+				OutModel.Positions.Add(FVector4f(Vertex.Position.X, Vertex.Position.Y, Vertex.Position.Z, Entry.bADC ? 0.f : 1.f));
+				OutModel.Normals.Add(Vertex.Normal);
+				OutModel.UVs.Add(Vertex.UV);
+				OutModel.Colors.Add(Vertex.Color);
+			}
+
+			OutStats.Strips.NumStrips += StripStats.NumStrips;
+			OutStats.Strips.NumStripTriangles += StripStats.NumStripTriangles;
+			OutStats.Strips.MaxStripTriangles = FMath::Max(OutStats.Strips.MaxStripTriangles, StripStats.MaxStripTriangles);
+			OutStats.Strips.NumBatches += StripStats.NumBatches;
+			OutStats.Strips.NumEntries += StripStats.NumEntries;
+			OutStats.Strips.NumExtraEntries += StripStats.NumExtraEntries;
+		}
+	}
+
+	static TArray<uint8> SerializeModel(const FModel& Model)
+	{
+		MeshFileHeader Header;
+		Header.pos.set((intptr_t)Model.Positions.GetData(), Model.Positions.Num() * sizeof(Vector));
+		Header.nrm.set((intptr_t)Model.Normals.GetData(), Model.Normals.Num() * sizeof(Vector));
+		Header.uvs.set((intptr_t)Model.UVs.GetData(), Model.UVs.Num() * sizeof(Vector2));
+		Header.colors.set((intptr_t)Model.Colors.GetData(), Model.Colors.Num() * sizeof(Vector));
+
+		std::vector<std::byte> Bytes;
+		Serializer s(Bytes);
+		serialize(s, Header, 1);
+		s.finish_serialization();
+
+		return TArray<uint8>(reinterpret_cast<const uint8*>(Bytes.data()), Bytes.size());
+	}
+
+	static FString GetLODFilename(const FString& Filename, int32 LODIndex)
+	{
+		return LODIndex == 0 ? Filename : FPaths::GetPath(Filename) / FString::Printf(TEXT("%s_LOD%d.%s"), *FPaths::GetBaseFilename(Filename), LODIndex, *FPaths::GetExtension(Filename));
+	}
+
+	// Builds a model and writes it to Ar, or to Filename if Ar is null, along with its sections sidecar
+	static bool WriteModel(const FMeshDescription& MeshDescription, const FString& Filename, FArchive* Ar, const UPS2LevelEditingDeveloperSettings& Settings, FPS2OperationReport& Report,
+		FModel& OutModel, FModelStats& OutStats)
+	{
+		BuildModel(MeshDescription, Settings, Report, OutModel, OutStats);
+
+		const TArray<uint8> Bytes = SerializeModel(OutModel);
+		bool bWritten = false;
+		if (Ar)
+		{
+			Ar->Serialize(const_cast<uint8*>(Bytes.GetData()), Bytes.Num());
+			bWritten = !Ar->IsError();
+		}
+		else
+		{
+			bWritten = FFileHelper::SaveArrayToFile(Bytes, *Filename);
+		}
+
+		// Without a filename there's nowhere for the sidecar, which only matters with more than one section
+		if (!Filename.IsEmpty())
+		{
+			bWritten &= SavePS2MeshSections(Filename, OutModel.Sections);
+		}
+
+		PS2_ADD_COUNTER(&Report, TrianglesIn, OutStats.NumTriangles);
+		PS2_ADD_COUNTER(&Report, VerticesIn, OutStats.NumWeldedVertices);
+		PS2_ADD_COUNTER(&Report, TrianglesOut, OutStats.Strips.NumStripTriangles);
+		PS2_ADD_COUNTER(&Report, VerticesOut, OutStats.Strips.NumEntries);
+		PS2_ADD_COUNTER(&Report, BytesWritten, Bytes.Num());
+
+		return bWritten;
+	}
+
+	// Builds one LOD and writes it to Ar, or to its own file if Ar is null
+	static bool ExportLOD(const UStaticMesh& StaticMesh, int32 LODIndex, const FString& Filename, FArchive* Ar, const UPS2LevelEditingDeveloperSettings& Settings, FPS2OperationReport& Report)
+	{
+		const FMeshDescription* MeshDescription = StaticMesh.GetMeshDescription(LODIndex);
+		if (MeshDescription == nullptr)
+		{
+			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("%s LOD%d has no source mesh, it's reduced from another LOD when the mesh is built. Not exported"), *StaticMesh.GetName(), LODIndex);
+			return false;
+		}
+
+		FModel Model;
+		FModelStats Stats;
+		const bool bWritten = WriteModel(*MeshDescription, Filename, Ar, Settings, Report, Model, Stats);
+
+		if (Filename.IsEmpty() && Model.Sections.Num() > 1)
+		{
+			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("%s has %d material sections but isn't exported to a file, they aren't saved"), *StaticMesh.GetName(), Model.Sections.Num());
+		}
+
+		const PS2MeshCore::FStripBuildStats& Strips = Stats.Strips;
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Exported %s LOD%d: %d triangles, %d vertices, %d sections. %lld strips, %.1f triangles per strip, longest %lld. %lld batches of %d, %lld strip entries, %lld of them extra"),
+			*StaticMesh.GetName(), LODIndex, Stats.NumTriangles, Stats.NumWeldedVertices, Model.Sections.Num(),
+			int64(Strips.NumStrips), Strips.NumStrips > 0 ? double(Strips.NumStripTriangles) / Strips.NumStrips : 0.0, int64(Strips.MaxStripTriangles),
+			int64(Strips.NumBatches), GetBatchSize(Settings), int64(Strips.NumEntries), int64(Strips.NumExtraEntries));
+
+		const FString Prefix = FString::Printf(TEXT("LOD%d"), LODIndex);
+		Report.SetDetail(Prefix + TEXT("Strips"), FString::Printf(TEXT("%lld"), int64(Strips.NumStrips)));
+		Report.SetDetail(Prefix + TEXT("MaxStripTriangles"), FString::Printf(TEXT("%lld"), int64(Strips.MaxStripTriangles)));
+		Report.SetDetail(Prefix + TEXT("Batches"), FString::Printf(TEXT("%lld"), int64(Strips.NumBatches)));
+		Report.SetDetail(Prefix + TEXT("ExtraEntries"), FString::Printf(TEXT("%lld"), int64(Strips.NumExtraEntries)));
+
+		return bWritten;
+	}
+}
+
+bool WritePS2Model(const FMeshDescription& MeshDescription, const FString& Filename, const UPS2LevelEditingDeveloperSettings& Settings, FPS2OperationReport& Report)
+{
+	using namespace PS2ModelExporter;
+
+	FModel Model;
+	FModelStats Stats;
+	return WriteModel(MeshDescription, Filename, nullptr, Settings, Report, Model, Stats);
+}
+
+UPS2ModelExporter::UPS2ModelExporter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	SupportedClass = UStaticMesh::StaticClass();
+	bText = false;
+	PreferredFormatIndex = 0;
+	FormatExtension.Add(TEXT("mdl"));
+	FormatDescription.Add(TEXT("PS2 Model File"));
+}
+
+bool UPS2ModelExporter::ExportBinary(UObject* Object, const TCHAR* Type, FArchive& Ar, FFeedbackContext* Warn, int32 FileIndex, uint32 PortFlags)
+{
+	using namespace PS2ModelExporter;
+
+	const UStaticMesh* StaticMesh = Cast<UStaticMesh>(Object);
+	if (StaticMesh == nullptr)
+	{
+		return false;
+	}
+
+	const UPS2LevelEditingDeveloperSettings* Settings = UPS2LevelEditingDeveloperSettings::Get();
+	const FString Filename = UExporter::CurrentFilename;
+
+	FPS2OperationReport Report(TEXT("ModelExport"));
+	Report.SetDetail(TEXT("Mesh"), StaticMesh->GetPathName());
+	Report.SetDetail(TEXT("Output"), Filename);
+	Report.SetDetail(TEXT("BatchSize"), FString::FromInt(GetBatchSize(*Settings)));
+
+	if (!ExportLOD(*StaticMesh, 0, Filename, &Ar, *Settings, Report))
+	{
+		return false;
+	}
+
+	// LODs go next to the model, which needs to know where that is
+	if (Settings->bExportLODs && StaticMesh->GetNumSourceModels() > 1)
+	{
+		if (Filename.IsEmpty())
+		{
+			UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("%s isn't exported to a file, its LODs aren't exported"), *StaticMesh->GetName());
+		}
+		else
+		{
+			for (int32 LODIndex = 1; LODIndex < StaticMesh->GetNumSourceModels(); ++LODIndex)
+			{
+				ExportLOD(*StaticMesh, LODIndex, GetLODFilename(Filename, LODIndex), nullptr, *Settings, Report);
+			}
+		}
+	}
+
+	const FString ReportDirectory = FPS2OperationReport::GetReportDirectory();
+	if (!ReportDirectory.IsEmpty())
+	{
+		Report.Write(ReportDirectory);
+	}
+	return true;
+}
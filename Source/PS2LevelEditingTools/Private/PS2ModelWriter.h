@@ -0,0 +1,17 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FMeshDescription;
+class FPS2OperationReport;
+class UPS2LevelEditingDeveloperSettings;
+
+/**
+ * Writes a mesh description as a .mdl file and its sections sidecar, stripified and batched for VU1 the same way
+ * UPS2ModelExporter writes a static mesh LOD. Only reads the mesh and settings, so it can run on any thread.
+ *
+ * @return False if either file couldn't be written.
+ */
+bool WritePS2Model(const FMeshDescription& MeshDescription, const FString& Filename, const UPS2LevelEditingDeveloperSettings& Settings, FPS2OperationReport& Report);
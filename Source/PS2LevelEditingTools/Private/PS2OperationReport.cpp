@@ -0,0 +1,326 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2OperationReport.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingTools.h"
+#include "Containers/Ticker.h"
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace PS2OperationReport
+{
+	// How long an import has to go without any work before its report is written
+	constexpr double ImportIdleSeconds = 2.0;
+	constexpr float ImportTickInterval = 0.5f;
+
+	static FCriticalSection ImportReportLock;
+	static TSharedPtr<FPS2OperationReport, ESPMode::ThreadSafe> ImportReport;
+	static FTSTicker::FDelegateHandle ImportTickerHandle;
+
+	static const TCHAR* const CounterNames[] =
+	{
+		TEXT("BytesRead"),
+		TEXT("VerticesIn"),
+		TEXT("VerticesOut"),
+		TEXT("TrianglesIn"),
+		TEXT("TrianglesOut"),
+		TEXT("DegeneratesDropped"),
+		TEXT("PayloadCacheHits"),
+		TEXT("InstancesExported"),
+		TEXT("AssetLookups"),
+		TEXT("BytesWritten"),
+		TEXT("MeshesBatched"),
+	};
+	static_assert(UE_ARRAY_COUNT(CounterNames) == int32(EPS2ReportCounter::Num), "Every counter needs a name");
+
+	static const TCHAR* const PhaseNames[] =
+	{
+		TEXT("Translate"),
+		TEXT("GetMeshPayloadData"),
+		TEXT("DecodeStrips"),
+		TEXT("WeldVertices"),
+		TEXT("BuildMeshDescription"),
+		TEXT("LoadManifest"),
+		TEXT("CollectStaticMeshes"),
+		TEXT("ConvertTransforms"),
+		TEXT("AssembleLevel"),
+		TEXT("PartitionLevel"),
+		TEXT("WriteoutLevel"),
+		TEXT("SimplifyLOD"),
+		TEXT("BuildStrips"),
+		TEXT("BatchStaticMeshes"),
+	};
+	static_assert(UE_ARRAY_COUNT(PhaseNames) == int32(EPS2ReportPhase::Num), "Every phase needs a name");
+
+	static bool FlushIdleImportReport(float)
+	{
+		TSharedPtr<FPS2OperationReport, ESPMode::ThreadSafe> Finished;
+		{
+			FScopeLock Lock(&ImportReportLock);
+			if (ImportReport.IsValid() && ImportReport->IsIdle(ImportIdleSeconds))
+			{
+				Finished = MoveTemp(ImportReport);
+			}
+		}
+
+		if (Finished.IsValid())
+		{
+			const FString Directory = FPS2OperationReport::GetReportDirectory();
+			if (!Directory.IsEmpty())
+			{
+				Finished->Write(Directory);
+			}
+		}
+		return true;
+	}
+}
+
+FPS2OperationReport::FPS2OperationReport(const FString& InOperation)
+	: Operation(InOperation)
+	, StartTime(FDateTime::Now())
+	, StartSeconds(FPlatformTime::Seconds())
+	, NumActivePhases(0)
+	, LastActivitySeconds(StartSeconds)
+{
+	for (std::atomic<int64>& Counter : Counters)
+	{
+		Counter.store(0, std::memory_order_relaxed);
+	}
+	for (int32 Phase = 0; Phase < int32(EPS2ReportPhase::Num); ++Phase)
+	{
+		PhaseCycles[Phase].store(0, std::memory_order_relaxed);
+		PhaseCalls[Phase].store(0, std::memory_order_relaxed);
+	}
+}
+
+void FPS2OperationReport::AddCounter(EPS2ReportCounter Counter, int64 Amount)
+{
+	Counters[int32(Counter)].fetch_add(Amount, std::memory_order_relaxed);
+	LastActivitySeconds.store(FPlatformTime::Seconds(), std::memory_order_relaxed);
+}
+
+void FPS2OperationReport::AddPhase(EPS2ReportPhase Phase, uint64 Cycles)
+{
+	PhaseCycles[int32(Phase)].fetch_add(Cycles, std::memory_order_relaxed);
+	PhaseCalls[int32(Phase)].fetch_add(1, std::memory_order_relaxed);
+	LastActivitySeconds.store(FPlatformTime::Seconds(), std::memory_order_relaxed);
+}
+
+void FPS2OperationReport::SetDetail(const FString& Key, const FString& Value)
+{
+	FScopeLock Lock(&DetailsLock);
+	if (TPair<FString, FString>* Existing = Details.FindByPredicate([&Key](const TPair<FString, FString>& Detail) { return Detail.Key == Key; }))
+	{
+		Existing->Value = Value;
+	}
+	else
+	{
+		Details.Emplace(Key, Value);
+	}
+}
+
+bool FPS2OperationReport::IsIdle(double IdleSeconds) const
+{
+	return NumActivePhases.load() == 0 && FPlatformTime::Seconds() - LastActivitySeconds.load() >= IdleSeconds;
+}
+
+bool FPS2OperationReport::Write(const FString& Directory) const
+{
+	using namespace PS2OperationReport;
+
+	const double WallSeconds = LastActivitySeconds.load() - StartSeconds;
+	const FString EngineVersion = FEngineVersion::Current().ToString();
+
+	TArray<TPair<FString, FString>> DetailsCopy;
+	{
+		FScopeLock Lock(&DetailsLock);
+		DetailsCopy = Details;
+	}
+
+	TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+	Root->SetStringField(TEXT("Operation"), Operation);
+	Root->SetStringField(TEXT("Start"), StartTime.ToIso8601());
+	Root->SetStringField(TEXT("EngineVersion"), EngineVersion);
+	Root->SetNumberField(TEXT("WallSeconds"), WallSeconds);
+
+	TSharedRef<FJsonObject> DetailsObject = MakeShared<FJsonObject>();
+	for (const TPair<FString, FString>& Detail : DetailsCopy)
+	{
+		DetailsObject->SetStringField(Detail.Key, Detail.Value);
+	}
+	Root->SetObjectField(TEXT("Details"), DetailsObject);
+
+	TSharedRef<FJsonObject> CountersObject = MakeShared<FJsonObject>();
+	for (int32 Counter = 0; Counter < int32(EPS2ReportCounter::Num); ++Counter)
+	{
+		CountersObject->SetNumberField(CounterNames[Counter], double(Counters[Counter].load()));
+	}
+	Root->SetObjectField(TEXT("Counters"), CountersObject);
+
+	TSharedRef<FJsonObject> PhasesObject = MakeShared<FJsonObject>();
+	for (int32 Phase = 0; Phase < int32(EPS2ReportPhase::Num); ++Phase)
+	{
+		const int32 Calls = PhaseCalls[Phase].load();
+		if (Calls == 0)
+		{
+			continue;
+		}
+		TSharedRef<FJsonObject> PhaseObject = MakeShared<FJsonObject>();
+		PhaseObject->SetNumberField(TEXT("Milliseconds"), FPlatformTime::ToMilliseconds64(PhaseCycles[Phase].load()));
+		PhaseObject->SetNumberField(TEXT("Calls"), Calls);
+		PhasesObject->SetObjectField(PhaseNames[Phase], PhaseObject);
+	}
+	Root->SetObjectField(TEXT("Phases"), PhasesObject);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Root, JsonWriter);
+
+	const FString JsonPath = Directory / FString::Printf(TEXT("%s-%s.json"), *Operation, *StartTime.ToString(TEXT("%Y%m%d-%H%M%S")));
+	bool bWritten = FFileHelper::SaveStringToFile(Json, *JsonPath);
+
+	// One row per operation, phases in milliseconds, so runs can be lined up in a spreadsheet
+	const FString CsvPath = Directory / Operation + TEXT(".csv");
+	FString CsvHeader = TEXT("Start,EngineVersion,WallSeconds");
+	for (const TCHAR* CounterName : CounterNames)
+	{
+		CsvHeader += FString::Printf(TEXT(",%s"), CounterName);
+	}
+	for (const TCHAR* PhaseName : PhaseNames)
+	{
+		CsvHeader += FString::Printf(TEXT(",%sMs"), PhaseName);
+	}
+
+	FString Csv;
+	bool bCsvAligned = true;
+	FString ExistingCsv;
+	if (FFileHelper::LoadFileToString(ExistingCsv, *CsvPath))
+	{
+		FString ExistingHeader;
+		if (!ExistingCsv.Split(TEXT("\n"), &ExistingHeader, nullptr))
+		{
+			ExistingHeader = ExistingCsv;
+		}
+		ExistingHeader.TrimEndInline();
+
+		if (ExistingHeader != CsvHeader)
+		{
+			const FString OldCsvPath = Directory / FString::Printf(TEXT("%s-%s.csv"), *Operation, *FDateTime::Now().ToString(TEXT("%Y%m%d-%H%M%S")));
+			bCsvAligned = IFileManager::Get().Move(*OldCsvPath, *CsvPath);
+			if (bCsvAligned)
+			{
+				UE_LOG(LogPS2LevelEditingTools, Log, TEXT("%s has different columns, moved it to %s"), *CsvPath, *OldCsvPath);
+				Csv += CsvHeader + LINE_TERMINATOR;
+			}
+		}
+	}
+	else
+	{
+		Csv += CsvHeader + LINE_TERMINATOR;
+	}
+	Csv += FString::Printf(TEXT("%s,%s,%.3f"), *StartTime.ToIso8601(), *EngineVersion, WallSeconds);
+	for (const std::atomic<int64>& Counter : Counters)
+	{
+		Csv += FString::Printf(TEXT(",%lld"), Counter.load());
+	}
+	for (const std::atomic<uint64>& Cycles : PhaseCycles)
+	{
+		Csv += FString::Printf(TEXT(",%.3f"), FPlatformTime::ToMilliseconds64(Cycles.load()));
+	}
+	Csv += LINE_TERMINATOR;
+	bWritten &= bCsvAligned && FFileHelper::SaveStringToFile(Csv, *CsvPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+	if (bWritten)
+	{
+		UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Wrote %s report to %s"), *Operation, *JsonPath);
+	}
+	else
+	{
+		UE_LOG(LogPS2LevelEditingTools, Warning, TEXT("Unable to write %s report to %s"), *Operation, *Directory);
+	}
+	return bWritten;
+}
+
+FString FPS2OperationReport::GetReportDirectory()
+{
+	check(IsInGameThread());
+
+	const UPS2LevelEditingDeveloperSettings* Settings = UPS2LevelEditingDeveloperSettings::Get();
+	if (!Settings->bWriteReports)
+	{
+		return FString();
+	}
+	if (!Settings->ReportDirectory.Path.IsEmpty())
+	{
+		return FPaths::ConvertRelativePathToFull(Settings->ReportDirectory.Path);
+	}
+	return FPaths::ProjectSavedDir() / TEXT("PS2LevelEditing") / TEXT("Reports");
+}
+
+TSharedRef<FPS2OperationReport, ESPMode::ThreadSafe> FPS2OperationReport::GetImportReport()
+{
+	using namespace PS2OperationReport;
+
+	FScopeLock Lock(&ImportReportLock);
+	if (!ImportReport.IsValid())
+	{
+		ImportReport = MakeShared<FPS2OperationReport, ESPMode::ThreadSafe>(TEXT("Import"));
+	}
+	return ImportReport.ToSharedRef();
+}
+
+void FPS2OperationReport::RegisterDelegates()
+{
+	using namespace PS2OperationReport;
+
+	check(IsInGameThread());
+
+	ImportTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&FlushIdleImportReport), ImportTickInterval);
+}
+
+void FPS2OperationReport::UnregisterDelegates()
+{
+	using namespace PS2OperationReport;
+
+	check(IsInGameThread());
+
+	FTSTicker::GetCoreTicker().RemoveTicker(ImportTickerHandle);
+	ImportTickerHandle.Reset();
+
+	// An import cut short by shutdown still gets its report if settings are still around to say where
+	FScopeLock Lock(&ImportReportLock);
+	if (ImportReport.IsValid() && UObjectInitialized())
+	{
+		const FString Directory = GetReportDirectory();
+		if (!Directory.IsEmpty())
+		{
+			ImportReport->Write(Directory);
+		}
+	}
+	ImportReport.Reset();
+}
+
+FPS2ReportPhaseScope::FPS2ReportPhaseScope(FPS2OperationReport* InReport, EPS2ReportPhase InPhase)
+	: Report(InReport)
+	, Phase(InPhase)
+	, StartCycles(0)
+{
+	if (Report)
+	{
+		Report->NumActivePhases.fetch_add(1);
+		StartCycles = FPlatformTime::Cycles64();
+	}
+}
+
+FPS2ReportPhaseScope::~FPS2ReportPhaseScope()
+{
+	if (Report)
+	{
+		Report->AddPhase(Phase, FPlatformTime::Cycles64() - StartCycles);
+		Report->NumActivePhases.fetch_sub(1);
+	}
+}
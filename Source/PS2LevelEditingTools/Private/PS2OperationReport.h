@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+/**
+ * Timed phases of an import or export. The names match the stats in PS2LevelEditingStats.h. Report CSVs have a column per
+ * phase and counter in enum order, add new ones at the end.
+ */
+enum class EPS2ReportPhase : uint8
+{
+	Translate,
+	GetMeshPayloadData,
+	DecodeStrips,
+	WeldVertices,
+	BuildMeshDescription,
+	LoadManifest,
+	CollectStaticMeshes,
+	ConvertTransforms,
+	AssembleLevel,
+	PartitionLevel,
+	WriteoutLevel,
+	SimplifyLOD,
+	BuildStrips,
+	BatchStaticMeshes,
+
+	Num
+};
+
+enum class EPS2ReportCounter : uint8
+{
+	BytesRead,
+	VerticesIn,
+	VerticesOut,
+	TrianglesIn,
+	TrianglesOut,
+	DegeneratesDropped,
+	PayloadCacheHits,
+	InstancesExported,
+	AssetLookups,
+	BytesWritten,
+	MeshesBatched,
+
+	Num
+};
+
+/**
+ * Where the time went and how much data went through one bulk import or map export, written out as a JSON file per
+ * operation and a row of a CSV file per kind of operation so it can be compared across releases. Phase times are added
+ * up over every thread that ran the phase, so parallel phases can add up to more than the wall time.
+ *
+ * Counters and phases can be added from any thread.
+ */
+class FPS2OperationReport
+{
+public:
+	explicit FPS2OperationReport(const FString& InOperation);
+
+	void AddCounter(EPS2ReportCounter Counter, int64 Amount);
+	void AddPhase(EPS2ReportPhase Phase, uint64 Cycles);
+
+	/** True once no phase is running and nothing has been added for IdleSeconds. */
+	bool IsIdle(double IdleSeconds) const;
+
+	/** Adds a line describing the operation, such as the output file. */
+	void SetDetail(const FString& Key, const FString& Value);
+
+	/**
+	 * Writes the report to Directory as <Operation>-<time>.json and appends it to <Operation>.csv. A CSV started with
+	 * different columns, by a build with other phases or counters, is renamed to <Operation>-<time>.csv first so its
+	 * rows stay lined up with its header.
+	 *
+	 * @return False if either file couldn't be written.
+	 */
+	bool Write(const FString& Directory) const;
+
+	/** Where reports go according to the developer settings, empty if they're turned off. Game thread only. */
+	static FString GetReportDirectory();
+
+	/**
+	 * The report of the import running now. Imports come in as a stream of translations and payload requests with
+	 * nothing marking the end of a batch, so the report is written and a new one started once nothing has been added
+	 * to it for a couple of seconds.
+	 */
+	static TSharedRef<FPS2OperationReport, ESPMode::ThreadSafe> GetImportReport();
+
+	static void RegisterDelegates();
+	static void UnregisterDelegates();
+
+private:
+	friend class FPS2ReportPhaseScope;
+
+	FString Operation;
+	FDateTime StartTime;
+	double StartSeconds;
+
+	std::atomic<int64> Counters[int32(EPS2ReportCounter::Num)];
+	std::atomic<uint64> PhaseCycles[int32(EPS2ReportPhase::Num)];
+	std::atomic<int32> PhaseCalls[int32(EPS2ReportPhase::Num)];
+
+	// Phases still running, and when one last started or finished, to tell when an import has gone quiet
+	std::atomic<int32> NumActivePhases;
+	std::atomic<double> LastActivitySeconds;
+
+	mutable FCriticalSection DetailsLock;
+	TArray<TPair<FString, FString>> Details;
+};
+
+/** Adds the time until the end of the scope to a phase of a report, see PS2_SCOPE_PHASE. */
+class FPS2ReportPhaseScope
+{
+public:
+	FPS2ReportPhaseScope(FPS2OperationReport* InReport, EPS2ReportPhase InPhase);
+	~FPS2ReportPhaseScope();
+
+private:
+	FPS2OperationReport* Report;
+	EPS2ReportPhase Phase;
+	uint64 StartCycles;
+};
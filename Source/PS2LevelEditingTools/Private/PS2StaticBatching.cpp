@@ -0,0 +1,304 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2StaticBatching.h"
+#include "PS2AssetIndex.h"
+#include "PS2AssetReferenceCache.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+#include "PS2LevelEditingStats.h"
+#include "PS2LevelEditingTools.h"
+#include "PS2ModelWriter.h"
+#include "PS2LevelEditingTools/PS2StaticMeshComponent.h"
+
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Materials/MaterialInterface.h"
+#include "StaticMeshAttributes.h"
+#include "StaticMeshOperations.h"
+
+namespace PS2StaticBatching
+{
+	// A component that can be batched, gathered on the game thread
+	struct FCandidate
+	{
+		const UStaticMeshComponent* Component;
+		const AActor* Actor;
+		const FMeshDescription* MeshDescription;
+		FTransform Transform;
+		FBox Bounds;
+		int32 NumVertices;
+	};
+
+	struct FCluster
+	{
+		FName MaterialSlotName;
+		TArray<int32> Candidates;
+		int32 NumVertices = 0;
+		FBox Bounds = FBox(ForceInit);
+	};
+
+	static bool CanBatch(const UStaticMeshComponent* Component, int32 MaxMeshVertices)
+	{
+		if (Component->Mobility != EComponentMobility::Static || Component->IsA<UInstancedStaticMeshComponent>())
+		{
+			return false;
+		}
+
+		// Its geometry is the asset it names, not its static mesh
+		const UPS2StaticMeshComponent* PS2Component = Cast<UPS2StaticMeshComponent>(Component);
+		if (PS2Component && !PS2Component->AssetPath.IsEmpty())
+		{
+			return false;
+		}
+
+		// Appending a mesh doesn't flip the winding of mirrored transforms
+		if (Component->GetComponentTransform().GetDeterminant() < 0.f)
+		{
+			return false;
+		}
+
+		const UStaticMesh* StaticMesh = Component->GetStaticMesh();
+		return StaticMesh && StaticMesh->GetStaticMaterials().Num() == 1 && Component->GetMaterial(0) && StaticMesh->GetNumVertices(0) <= MaxMeshVertices;
+	}
+
+	// Merges a cluster's meshes into one polygon group, relative to the center of their bounds
+	static void MergeCluster(const FCluster& Cluster, TConstArrayView<FCandidate> Candidates, FMeshDescription& OutMeshDescription)
+	{
+		FStaticMeshAttributes Attributes(OutMeshDescription);
+		Attributes.Register();
+
+		const FPolygonGroupID PolygonGroup = OutMeshDescription.CreatePolygonGroup();
+		Attributes.GetPolygonGroupMaterialSlotNames()[PolygonGroup] = Cluster.MaterialSlotName;
+
+		// Appending matches polygon groups by slot name, which differs between meshes using the same material
+		FStaticMeshOperations::FAppendSettings AppendSettings;
+		AppendSettings.PolygonGroupsDelegate = FStaticMeshOperations::FAppendPolygonGroupsDelegate::CreateLambda([PolygonGroup](const FMeshDescription& SourceMesh, FMeshDescription&, TMap<FPolygonGroupID, FPolygonGroupID>& RemapPolygonGroups)
+			{
+				for (const FPolygonGroupID SourceGroup : SourceMesh.PolygonGroups().GetElementIDs())
+				{
+					RemapPolygonGroups.Add(SourceGroup, PolygonGroup);
+				}
+			}
+		);
+
+		const FVector Pivot = Cluster.Bounds.GetCenter();
+		for (const int32 CandidateIndex : Cluster.Candidates)
+		{
+			const FCandidate& Candidate = Candidates[CandidateIndex];
+
+			FTransform Transform = Candidate.Transform;
+			Transform.AddToTranslation(-Pivot);
+			AppendSettings.MeshTransform = Transform;
+
+			FStaticMeshOperations::AppendMeshDescriptions({ Candidate.MeshDescription }, OutMeshDescription, AppendSettings);
+		}
+	}
+}
+
+FPS2StaticBatchDirectories::FPS2StaticBatchDirectories(const FString& OutputDirectory)
+	: Output(OutputDirectory)
+	, Staging(OutputDirectory.IsEmpty() ? FString() : OutputDirectory + TEXT(".tmp"))
+	, Backup(OutputDirectory.IsEmpty() ? FString() : OutputDirectory + TEXT(".old"))
+{
+}
+
+// Directories are moved with the platform file, IFileManager::Move only moves files
+bool FPS2StaticBatchDirectories::SwapIn() const
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	IFileManager::Get().DeleteDirectory(*Backup, false, true);
+	if (PlatformFile.DirectoryExists(*Output) && !PlatformFile.MoveFile(*Backup, *Output))
+	{
+		UE_LOG(LogPS2LevelEditingTools, Error, TEXT("Unable to move the previous static mesh batches out of %s"), *Output);
+		return false;
+	}
+
+	// No batches were made this time, the previous ones only go
+	if (!PlatformFile.DirectoryExists(*Staging))
+	{
+		return true;
+	}
+
+	if (!PlatformFile.MoveFile(*Output, *Staging))
+	{
+		UE_LOG(LogPS2LevelEditingTools, Error, TEXT("Unable to move the static mesh batches to %s"), *Output);
+		if (PlatformFile.DirectoryExists(*Backup))
+		{
+			PlatformFile.MoveFile(*Output, *Backup);
+		}
+		return false;
+	}
+	return true;
+}
+
+void FPS2StaticBatchDirectories::Restore() const
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	IFileManager::Get().DeleteDirectory(*Output, false, true);
+	if (PlatformFile.DirectoryExists(*Backup) && !PlatformFile.MoveFile(*Output, *Backup))
+	{
+		UE_LOG(LogPS2LevelEditingTools, Error, TEXT("Unable to restore the previous static mesh batches from %s"), *Backup);
+	}
+}
+
+void FPS2StaticBatchDirectories::Cleanup() const
+{
+	IFileManager::Get().DeleteDirectory(*Staging, false, true);
+	IFileManager::Get().DeleteDirectory(*Backup, false, true);
+}
+
+void BuildPS2StaticBatches(TConstArrayView<AActor*> Actors, const FString& OutputDirectory, const FString& ManifestDirectory, bool bParallel, FPS2StaticBatches& OutBatches, FPS2OperationReport& Report)
+{
+	using namespace PS2StaticBatching;
+
+	check(IsInGameThread());
+
+	const UPS2LevelEditingDeveloperSettings* Settings = UPS2LevelEditingDeveloperSettings::Get();
+	const double CellSize = FMath::Max(Settings->StaticBatchCellSize, 100.f);
+	const int32 MaxMeshes = FMath::Max(Settings->StaticBatchMaxMeshes, 2);
+
+	// Candidates are grouped by material and cell as they're found, so each group is in actor and component order
+	TArray<FCandidate> Candidates;
+	TMap<TPair<const UMaterialInterface*, FIntVector>, TArray<int32>> Groups;
+	for (AActor* Actor : Actors)
+	{
+		TArray<UStaticMeshComponent*> Meshes;
+		Actor->GetComponents(Meshes);
+
+		for (const UStaticMeshComponent* Mesh : Meshes)
+		{
+			if (!CanBatch(Mesh, Settings->StaticBatchMaxMeshVertices))
+			{
+				continue;
+			}
+
+			// Meshes that wouldn't be exported aren't batched either
+			PS2_ADD_COUNTER(&Report, AssetLookups, 1);
+			if (!FPS2AssetReferenceCache::Resolve(Mesh).IsSet())
+			{
+				continue;
+			}
+
+			const FMeshDescription* MeshDescription = Mesh->GetStaticMesh()->GetMeshDescription(0);
+			if (MeshDescription == nullptr)
+			{
+				continue;
+			}
+
+			const FBox Bounds = Mesh->Bounds.GetBox();
+			const FVector Center = Bounds.GetCenter();
+			const FIntVector Cell(FMath::FloorToInt32(Center.X / CellSize), FMath::FloorToInt32(Center.Y / CellSize), FMath::FloorToInt32(Center.Z / CellSize));
+
+			Groups.FindOrAdd({ Mesh->GetMaterial(0), Cell }).Add(Candidates.Num());
+			Candidates.Add({ Mesh, Actor, MeshDescription, Mesh->GetComponentTransform(), Bounds, Mesh->GetStaticMesh()->GetNumVertices(0) });
+		}
+	}
+
+	// The map's order depends on material addresses. Batches are numbered in material path and cell order instead, so
+	// the same level exports the same batch files and entries every time
+	struct FSortedGroup
+	{
+		FString MaterialPath;
+		FIntVector Cell;
+		const UMaterialInterface* Material;
+		const TArray<int32>* Candidates;
+	};
+	TArray<FSortedGroup> SortedGroups;
+	for (const TPair<TPair<const UMaterialInterface*, FIntVector>, TArray<int32>>& Group : Groups)
+	{
+		SortedGroups.Add({ Group.Key.Key->GetPathName(), Group.Key.Value, Group.Key.Key, &Group.Value });
+	}
+	SortedGroups.Sort([](const FSortedGroup& A, const FSortedGroup& B)
+		{
+			if (A.MaterialPath != B.MaterialPath)
+			{
+				return A.MaterialPath < B.MaterialPath;
+			}
+			if (A.Cell.X != B.Cell.X)
+			{
+				return A.Cell.X < B.Cell.X;
+			}
+			if (A.Cell.Y != B.Cell.Y)
+			{
+				return A.Cell.Y < B.Cell.Y;
+			}
+			return A.Cell.Z < B.Cell.Z;
+		}
+	);
+
+	TArray<FCluster> Clusters;
+	for (const FSortedGroup& Group : SortedGroups)
+	{
+		int32 ClusterIndex = INDEX_NONE;
+		for (const int32 CandidateIndex : *Group.Candidates)
+		{
+			const FCandidate& Candidate = Candidates[CandidateIndex];
+			if (ClusterIndex == INDEX_NONE || Clusters[ClusterIndex].Candidates.Num() == MaxMeshes || Clusters[ClusterIndex].NumVertices + Candidate.NumVertices > Settings->StaticBatchMaxVertices)
+			{
+				ClusterIndex = Clusters.AddDefaulted();
+				Clusters[ClusterIndex].MaterialSlotName = Group.Material->GetFName();
+			}
+
+			FCluster& Cluster = Clusters[ClusterIndex];
+			Cluster.Candidates.Add(CandidateIndex);
+			Cluster.NumVertices += Candidate.NumVertices;
+			Cluster.Bounds += Candidate.Bounds;
+		}
+	}
+	Clusters.RemoveAll([](const FCluster& Cluster) { return Cluster.Candidates.Num() < 2; });
+
+	// Left over if the editor closed in the middle of an export
+	OutBatches.Directories = FPS2StaticBatchDirectories(OutputDirectory);
+	OutBatches.Directories.Cleanup();
+
+	TArray<bool> Written;
+	Written.SetNumZeroed(Clusters.Num());
+	ParallelFor(Clusters.Num(), [&](int32 ClusterIndex)
+		{
+			FMeshDescription MeshDescription;
+			MergeCluster(Clusters[ClusterIndex], Candidates, MeshDescription);
+
+			const FString Filename = OutBatches.Directories.Staging / FString::Printf(TEXT("batch_%d.mdl"), ClusterIndex);
+			Written[ClusterIndex] = WritePS2Model(MeshDescription, Filename, *Settings, Report);
+			if (!Written[ClusterIndex])
+			{
+				UE_LOG(LogPS2LevelEditingTools, Error, TEXT("Failed to write static mesh batch %s, its meshes are exported on their own"), *Filename);
+			}
+		},
+		bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread
+	);
+
+	int32 NumBatchedMeshes = 0;
+	for (int32 ClusterIndex = 0; ClusterIndex < Clusters.Num(); ++ClusterIndex)
+	{
+		if (!Written[ClusterIndex])
+		{
+			continue;
+		}
+
+		const FCluster& Cluster = Clusters[ClusterIndex];
+		FString Path = OutputDirectory / FString::Printf(TEXT("batch_%d.mdl"), ClusterIndex);
+		FPaths::MakePathRelativeTo(Path, *(ManifestDirectory + TEXT("/")));
+
+		FPS2StaticBatch& Batch = OutBatches.Batches.AddDefaulted_GetRef();
+		Batch.Reference = FPS2AssetIndex::MakeReference(Path);
+		Batch.Transform = FTransform(Cluster.Bounds.GetCenter());
+		Batch.LocalBounds = Cluster.Bounds.ShiftBy(-Cluster.Bounds.GetCenter());
+		OutBatches.Paths.Add(Path);
+
+		for (const int32 CandidateIndex : Cluster.Candidates)
+		{
+			OutBatches.BatchedMeshes.Add(Candidates[CandidateIndex].Component);
+			OutBatches.BatchedActors.Add(Candidates[CandidateIndex].Actor);
+		}
+		NumBatchedMeshes += Cluster.Candidates.Num();
+	}
+
+	PS2_ADD_COUNTER(&Report, MeshesBatched, NumBatchedMeshes);
+	UE_LOG(LogPS2LevelEditingTools, Log, TEXT("Batched %d of %d small static meshes into %d meshes in %s"), NumBatchedMeshes, Candidates.Num(), OutBatches.Batches.Num(), *OutputDirectory);
+}
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "egg/asset.hpp"
+
+class AActor;
+class FPS2OperationReport;
+class UStaticMeshComponent;
+
+/** A merged mesh standing in for several static mesh components. */
+struct FPS2StaticBatch
+{
+	Asset::Reference Reference;
+
+	// Translation to the center of the merged meshes' bounds, the merged vertices are relative to it
+	FTransform Transform;
+
+	// Bounds of the merged mesh, relative to Transform
+	FBox LocalBounds = FBox(ForceInit);
+};
+
+/**
+ * Where an export's batch files go. They're written to Staging while the level is built and only swapped in for the
+ * previous export's batches once its level file is complete, so a cancelled or failed export leaves the previous level
+ * and the batches it uses as they were.
+ *
+ * SwapIn, Restore and Cleanup run on the thread writing the level.
+ */
+struct FPS2StaticBatchDirectories
+{
+	FString Output;
+	FString Staging;
+	FString Backup;
+
+	explicit FPS2StaticBatchDirectories(const FString& OutputDirectory = FString());
+
+	bool IsSet() const { return !Output.IsEmpty(); }
+
+	/** Moves the previous batches to Backup and the staged ones to Output. Leaves the previous ones in place on failure. */
+	bool SwapIn() const;
+
+	/** Undoes SwapIn, for when the level couldn't be moved into place after it. */
+	void Restore() const;
+
+	/** Deletes the staged and backed up batches, whichever are left. */
+	void Cleanup() const;
+};
+
+struct FPS2StaticBatches
+{
+	FPS2StaticBatchDirectories Directories;
+
+	TArray<FPS2StaticBatch> Batches;
+
+	// Components merged into a batch, which aren't exported on their own, and the actors they belong to
+	TSet<const UStaticMeshComponent*> BatchedMeshes;
+	TSet<const AActor*> BatchedActors;
+
+	// Paths relative to the manifest directory the batches were written to
+	TSet<FString> Paths;
+};
+
+/**
+ * Merges small static meshes that share a material and sit close together into one pre-transformed mesh per batch, so
+ * the runtime draws them with one DMA chain instead of one each.
+ *
+ * A component is batched if it has static mobility, isn't instanced or mirrored, doesn't name its own PS2 asset, would
+ * otherwise be exported, and its mesh has a single material and at most StaticBatchMaxMeshVertices vertices. Components
+ * are grouped by material and by the cube of StaticBatchCellSize holding the center of their bounds, then each group is
+ * cut into batches in actor and component order, up to StaticBatchMaxMeshes meshes and StaticBatchMaxVertices vertices
+ * each. Groups and leftovers of one mesh are exported as they are.
+ *
+ * Batches are staged for OutputDirectory as batch_<n>.mdl, see FPS2StaticBatchDirectories, and referenced by their path
+ * relative to ManifestDirectory. A batch that can't be written is dropped and its meshes are exported on their own.
+ *
+ * Game thread only. Merging and writing the batches runs on workers when bParallel is set.
+ */
+void BuildPS2StaticBatches(TConstArrayView<AActor*> Actors, const FString& OutputDirectory, const FString& ManifestDirectory, bool bParallel, FPS2StaticBatches& OutBatches, FPS2OperationReport& Report);
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2StripDecoder.h"
+#include "Core/PS2MeshCore.h"
+
+#include "egg/mesh_header.hpp"
+
+static_assert(int32(PS2MeshCore::EStripRestartMode::None) == int32(EPS2StripRestartMode::None), "Restart modes must match");
+static_assert(int32(PS2MeshCore::EStripRestartMode::PositionW) == int32(EPS2StripRestartMode::PositionW), "Restart modes must match");
+static_assert(sizeof(Vector) == sizeof(float) * 4, "Positions are read as four floats");
+
+void DecodePS2Strips(const MeshFileHeader& Header, EPS2StripRestartMode RestartMode, TArray<uint32>& OutIndices, FPS2StripDecodeStats* OutStats)
+{
+	DecodePS2Strips(Header, 0, int32(Header.pos.num_elements()), RestartMode, OutIndices, OutStats);
+}
+
+void DecodePS2Strips(const MeshFileHeader& Header, int32 FirstVertex, int32 NumVertices, EPS2StripRestartMode RestartMode, TArray<uint32>& OutIndices, FPS2StripDecodeStats* OutStats)
+{
+	check(FirstVertex >= 0 && NumVertices >= 0 && size_t(FirstVertex) + size_t(NumVertices) <= Header.pos.num_elements());
+
+	PS2MeshCore::FStripDecodeStats Stats;
+
+	OutIndices.SetNumUninitialized(PS2MeshCore::MaxStripIndices(NumVertices));
+
+	if (NumVertices > 0)
+	{
+		const uint8* Positions = reinterpret_cast<const uint8*>(&Header.pos[FirstVertex]);
+		const size_t NumIndices = PS2MeshCore::DecodeStrips(Positions, sizeof(Vector), NumVertices, PS2MeshCore::EStripRestartMode(RestartMode), OutIndices.GetData(), &Stats);
+		OutIndices.SetNum(NumIndices, false);
+	}
+	else
+	{
+		OutIndices.Reset();
+	}
+
+	if (OutStats)
+	{
+		OutStats->NumStripTriangles = Stats.NumStripTriangles;
+		OutStats->NumSkippedTriangles = Stats.NumSkippedTriangles;
+		OutStats->NumDegenerateTriangles = Stats.NumDegenerateTriangles;
+	}
+}
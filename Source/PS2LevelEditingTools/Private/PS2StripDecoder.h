@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PS2LevelEditingDeveloperSettings.h"
+
+struct MeshFileHeader;
+
+struct FPS2StripDecodeStats
+{
+	// Triangles the strip would draw if every vertex kicked one
+	int32 NumStripTriangles = 0;
+
+	// Triangles not drawn because their last vertex has ADC set
+	int32 NumSkippedTriangles = 0;
+
+	// Triangles dropped because two of their corners are the same point or they have no area
+	int32 NumDegenerateTriangles = 0;
+};
+
+/**
+ * Turns the strips in a .mdl file into a triangle list indexing the file's vertices. Strips are stitched together
+ * with repeated vertices and, depending on RestartMode, restarted with the ADC flag. Stitching and restart triangles
+ * are never drawn on the PS2 so they are left out, as is anything else with no area.
+ *
+ * The winding of every other triangle is flipped so the whole list faces the same way.
+ */
+void DecodePS2Strips(const MeshFileHeader& Header, EPS2StripRestartMode RestartMode, TArray<uint32>& OutIndices, FPS2StripDecodeStats* OutStats = nullptr);
+
+/**
+ * As above for the strip entries FirstVertex to FirstVertex + NumVertices only, such as one section of the file. Indices
+ * start from FirstVertex, so the first entry of the range is index 0.
+ */
+void DecodePS2Strips(const MeshFileHeader& Header, int32 FirstVertex, int32 NumVertices, EPS2StripRestartMode RestartMode, TArray<uint32>& OutIndices, FPS2StripDecodeStats* OutStats = nullptr);
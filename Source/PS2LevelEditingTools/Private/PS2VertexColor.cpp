@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2VertexColor.h"
+#include "Misc/ScopeLock.h"
+
+TSharedRef<const FPS2VertexColorLinearizer, ESPMode::ThreadSafe> FPS2VertexColorLinearizer::Get(float Gamma)
+{
+	static FCriticalSection TablesLock;
+	static TArray<TSharedRef<const FPS2VertexColorLinearizer, ESPMode::ThreadSafe>> Tables;
+
+	FScopeLock Lock(&TablesLock);
+	for (const TSharedRef<const FPS2VertexColorLinearizer, ESPMode::ThreadSafe>& Table : Tables)
+	{
+		if (Table->GetGamma() == Gamma)
+		{
+			return Table;
+		}
+	}
+
+	// Only a couple of gammas are ever used in a session so these are never freed
+	return Tables.Add_GetRef(MakeShareable(new FPS2VertexColorLinearizer(Gamma)));
+}
+
+FPS2VertexColorLinearizer::FPS2VertexColorLinearizer(float InGamma)
+	: Linearizer(InGamma)
+{
+}
+
+float FPS2VertexColorLinearizer::Linearize(float Value) const
+{
+	return Linearizer.Linearize(Value);
+}
+
+void FPS2VertexColorLinearizer::LinearizeColors(const uint8* Source, SIZE_T Stride, int32 Num, bool bLinearizeAlpha, FVector4f* OutColors) const
+{
+	static_assert(sizeof(FVector4f) == sizeof(float) * 4, "Output is written as packed float quads");
+	Linearizer.LinearizeColors(Source, Stride, Num, bLinearizeAlpha, &OutColors->X);
+}
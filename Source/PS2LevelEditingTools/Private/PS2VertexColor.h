@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Core/PS2MeshCore.h"
+
+/**
+ * Converts PS2 vertex colors to linear. PS2 colors are scaled so 0x80 is full intensity, which makes values up to 2
+ * valid, so the curve is tabulated over [0, 2] and interpolated. Values outside of that range fall back to FMath::Pow.
+ *
+ * Tables are immutable and shared between payload tasks, use Get to fetch the one for a gamma. The table itself is a
+ * PS2MeshCore::FColorLinearizer.
+ */
+class FPS2VertexColorLinearizer
+{
+public:
+	/** Returns the shared table for Gamma, building it the first time it's asked for. Safe to call from any thread. */
+	static TSharedRef<const FPS2VertexColorLinearizer, ESPMode::ThreadSafe> Get(float Gamma);
+
+	float Linearize(float Value) const;
+
+	/**
+	 * Linearizes an array of colors. Each element starts with four floats (r, g, b, a) and Stride is the distance in
+	 * bytes between two elements.
+	 *
+	 * @param bLinearizeAlpha - Apply the curve to alpha as well, otherwise alpha is copied as is.
+	 */
+	void LinearizeColors(const uint8* Source, SIZE_T Stride, int32 Num, bool bLinearizeAlpha, FVector4f* OutColors) const;
+
+	float GetGamma() const { return Linearizer.GetGamma(); }
+
+private:
+	explicit FPS2VertexColorLinearizer(float InGamma);
+
+	PS2MeshCore::FColorLinearizer Linearizer;
+};
@@ -0,0 +1,20 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PS2VertexTransform.h"
+#include "Core/PS2MeshCore.h"
+
+static_assert(sizeof(FVector3f) == sizeof(float) * 3, "Output is written as packed float triples");
+
+namespace PS2VertexTransform
+{
+	void TransformPositions(const uint8* Source, SIZE_T Stride, int32 Num, const FMatrix44f& Transform, FVector3f* OutPositions)
+	{
+		PS2MeshCore::TransformPositions(Source, Stride, Num, Transform.M, &OutPositions->X);
+	}
+
+	void TransformNormals(const uint8* Source, SIZE_T Stride, int32 Num, const FMatrix44f& Transform, FVector3f* OutNormals)
+	{
+		PS2MeshCore::TransformNormals(Source, Stride, Num, Transform.M, &OutNormals->X);
+	}
+}
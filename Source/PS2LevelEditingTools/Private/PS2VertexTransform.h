@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Batch conversion of PS2 vertex data into the UE basis. The PS2 basis is Y up, so X/Y/Z in the file become X/Z/Y
+ * in UE. The basis swap is folded into the matrix once per call and every point is then transformed with SSE, or
+ * plain floats on platforms without it. The work is done by PS2MeshCore, these take engine types.
+ *
+ * The source arrays may be interleaved with other data, Stride is the distance in bytes between two elements and each
+ * element starts with three floats.
+ */
+namespace PS2VertexTransform
+{
+	/** Converts positions to the UE basis and transforms them by Transform, including its translation and scale. */
+	void TransformPositions(const uint8* Source, SIZE_T Stride, int32 Num, const FMatrix44f& Transform, FVector3f* OutPositions);
+
+	/** Converts normals to the UE basis and rotates them by Transform. Translation is ignored. */
+	void TransformNormals(const uint8* Source, SIZE_T Stride, int32 Num, const FMatrix44f& Transform, FVector3f* OutNormals);
+}
@@ -41,6 +41,13 @@ public:
 	 */
 	virtual TFuture<TOptional<UE::Interchange::FMeshPayloadData>> GetMeshPayloadData(const FInterchangeMeshPayLoadKey& PayLoadKey, const FTransform& MeshGlobalTransform) const override;
 
-	TArray64<uint8> MeshFile;
-	struct MeshFileHeader* MeshHeader;
+	/** Drops this translator's reference to the opened source file. */
+	virtual void ReleaseSource() override;
+
+private:
+	/** Returns the shared, immutable view of the source file, opening it if this translator hasn't yet. */
+	TSharedPtr<const class FPS2MeshFile, ESPMode::ThreadSafe> GetMeshFile() const;
+
+	mutable FCriticalSection MeshFileLock;
+	mutable TSharedPtr<const class FPS2MeshFile, ESPMode::ThreadSafe> MeshFile;
 };
@@ -7,6 +7,28 @@
 #include "MaterialDomain.h"
 #include "PS2LevelEditingDeveloperSettings.generated.h"
 
+/** Where strip restarts in imported models come from. */
+UENUM()
+enum class EPS2StripRestartMode : uint8
+{
+	/** Strips are only joined by stitching vertices, which decode to degenerate triangles. */
+	None,
+
+	/** A position W of zero marks a vertex with the ADC flag set. Its triangle isn't drawn and two in a row restart the strip. */
+	PositionW
+};
+
+/** How instance transforms are stored in exported levels. */
+UENUM()
+enum class EPS2TransformEncoding : uint8
+{
+	/** Full 4x4 float matrices, 64 bytes each. */
+	Matrix,
+
+	/** Position quantized within its section's bounds, smallest three quaternion and half float scale, 20 bytes each. */
+	Compact
+};
+
 /**
  * 
  */
@@ -16,8 +38,8 @@ class PS2LEVELEDITINGTOOLS_API UPS2LevelEditingDeveloperSettings : public UDevel
 	GENERATED_BODY()
 	
 public:
-	// Path to the PS2 manifest file. This should be MANIFEST.HST
-	UPROPERTY(config, EditAnywhere, Category = "PS2 Level Editing Settings", meta=(ConfigRestartRequired = true))
+	// Path to the PS2 manifest file. This should be MANIFEST.HST. It's reloaded whenever it changes
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Level Editing Settings")
 		FFilePath ManifestPath;
 
 	UPROPERTY(config, EditAnywhere, Category = "PS2 Level Editing Settings")
@@ -26,5 +48,129 @@ public:
 	UPROPERTY(config, EditAnywhere, Category = "PS2 Level Editing Settings")
 		TSoftObjectPtr<UMaterialInterface> ModelMaterial = UMaterial::GetDefaultMaterial(MD_Surface);
 
+	// Merge strip vertices that share the same position, normal, uv and color when importing models
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import")
+		bool bWeldVertices = true;
+
+	// How strip restarts are encoded in model files. Stitching and restart triangles are dropped on import
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import")
+		EPS2StripRestartMode StripRestartMode = EPS2StripRestartMode::None;
+
+	// Gamma used to convert imported vertex colors to linear. 1 leaves them as they are
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import", meta = (ClampMin = "0.1", UIMin = "1.0", UIMax = "3.0"))
+		float VertexColorGamma = 2.2f;
+
+	// Apply the vertex color gamma to alpha as well. Turn off if alpha is used as a mask or blend weight
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import")
+		bool bLinearizeVertexAlpha = true;
+
+	// Generate simplified LODs for imported models. Seams in UVs and vertex colors are kept where they are
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import")
+		bool bGenerateLODs = false;
+
+	// Fraction of LOD0's triangles each generated LOD aims for, one entry per LOD after LOD0
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import", meta = (EditCondition = "bGenerateLODs", ClampMin = "0.0", ClampMax = "1.0"))
+		TArray<float> LODTriangleRatios = { 0.5f, 0.25f, 0.125f };
+
+	// Largest error a generated LOD may have, relative to the size of the model. A LOD that can't reach its triangle
+	// target within it keeps more triangles
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import", meta = (EditCondition = "bGenerateLODs", ClampMin = "0.0", UIMax = "0.1"))
+		float LODMaxError = 0.02f;
+
+	// Keep imported model payloads in the derived data cache, keyed on file contents and the settings above, so reimporting
+	// an unchanged model doesn't rebuild it
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Import")
+		bool bCachePayloads = true;
+
+	// Qwords of VU1 data memory one batch of an exported model's vertices is uploaded to. The default is half of VU1
+	// memory less room for constants, for double buffering. Must match the runtime
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Export", meta = (ClampMin = "40", ClampMax = "1024"))
+		int32 VU1BatchBufferQwords = 496;
+
+	// Qwords of each batch buffer taken by the batch header and GIF tag rather than vertices. Must match the runtime
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Export", meta = (ClampMin = "0", ClampMax = "64"))
+		int32 VU1BatchHeaderQwords = 8;
+
+	// Also export every LOD after LOD0 of a mesh, next to the model as <name>_LOD<n>.mdl, for distance LODs
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Model Export")
+		bool bExportLODs = true;
+
+	// Name of the .lvl file each level is exported to, in the assets directory next to the manifest
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		TMap<TSoftObjectPtr<UWorld>, FString> LevelOutputNames;
+
+	// Name of the .lvl file for levels that aren't in LevelOutputNames
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		FString DefaultLevelOutputName = TEXT("new_level");
+
+	// Convert exported transforms on worker threads. The level file is the same either way
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		bool bParallelExport = true;
+
+	// Keep each actor's converted meshes between exports and only collect the actors that changed since. The level file is
+	// the same either way
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		bool bIncrementalExport = false;
+
+	// Export foliage grouped by mesh, so each mesh is stored once followed by all of its instances. Otherwise every foliage
+	// instance is exported as its own mesh reference and transform. Grouped foliage is only in the instance groups section,
+	// leave this off for runtimes that don't read it
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		bool bGroupFoliageInstances = false;
+
+	// Split the exported level into a grid of cells on the ground plane, each stored in its own section with its bounds,
+	// so the runtime can cull and stream the level a cell at a time
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		bool bPartitionLevel = false;
+
+	// Width of a partition cell in level units
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "bPartitionLevel", ClampMin = "100.0", UIMin = "1000.0", UIMax = "100000.0"))
+		float PartitionCellSize = 5000.f;
+
+	// How foliage and partition cell transforms are stored. Individually placed meshes in an unpartitioned level always use
+	// matrices, as the LevelFileHeader only holds matrices
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		EPS2TransformEncoding TransformEncoding = EPS2TransformEncoding::Matrix;
+
+	// Largest position error in level units a compact section may have. Sections over it are stored as matrices
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "TransformEncoding == EPS2TransformEncoding::Compact", ClampMin = "0.0"))
+		float CompactMaxPositionError = 0.5f;
+
+	// Largest error in the rotation and scale part of a compact transform, relative to its scale. About the rotation error
+	// in radians. Sections over it, for example ones with sheared instances, are stored as matrices
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "TransformEncoding == EPS2TransformEncoding::Compact", ClampMin = "0.0"))
+		float CompactMaxBasisError = 0.002f;
+
+	// Merge small static meshes that are close together and share a material into one pre-transformed mesh, exported as a
+	// single level entry, to cut the draw calls and DMA chains of scattered props. The merged meshes are written next to
+	// the level and go in the manifest the next time the asset pipeline builds it
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export")
+		bool bBatchStaticMeshes = false;
+
+	// Width of the cubes meshes are batched within, in level units. Only meshes whose bounds are centered in the same cube
+	// end up in a batch
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "bBatchStaticMeshes", ClampMin = "100.0", UIMin = "500.0", UIMax = "20000.0"))
+		float StaticBatchCellSize = 2000.f;
+
+	// Most meshes merged into one batch
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "bBatchStaticMeshes", ClampMin = "2"))
+		int32 StaticBatchMaxMeshes = 32;
+
+	// Most vertices in one batch, counted from the meshes' LOD0 render data
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "bBatchStaticMeshes", ClampMin = "3"))
+		int32 StaticBatchMaxVertices = 4096;
+
+	// Meshes with more vertices than this are always exported on their own
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Map Export", meta = (EditCondition = "bBatchStaticMeshes", ClampMin = "3"))
+		int32 StaticBatchMaxMeshVertices = 256;
+
+	// Write a JSON report and a CSV row with phase timings and counts after each batch of model imports and each map export
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Reports")
+		bool bWriteReports = false;
+
+	// Directory reports are written to. Empty uses Saved/PS2LevelEditing/Reports in the project
+	UPROPERTY(config, EditAnywhere, Category = "PS2 Reports", meta = (EditCondition = "bWriteReports"))
+		FDirectoryPath ReportDirectory;
+
 	static UPS2LevelEditingDeveloperSettings* Get() { return GetMutableDefault<ThisClass>(); }
 };
@@ -16,6 +16,9 @@ public:
 
 	static void ExportMap(TArray<AActor*> SelectedActors);
 
+	/** Cancels a map export that's still being written and waits for it to stop. */
+	static void CancelExport();
+
 protected:
 	static TSharedRef<FExtender> OnExtendLevelEditorActorContextMenu(const TSharedRef<FUICommandList> CommandList, const TArray<AActor*> SelectedActors);
 };
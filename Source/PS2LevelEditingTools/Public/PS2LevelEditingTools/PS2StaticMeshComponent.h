@@ -15,6 +15,7 @@ class PS2LEVELEDITINGTOOLS_API UPS2StaticMeshComponent : public UStaticMeshCompo
 	GENERATED_BODY()
 	
 public:
+	// PS2 asset to export this component as, relative to the manifest directory. Takes priority over the static mesh's source file
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "PS2 Static Mesh Component")
 		FString AssetPath;
 };
@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Exporters/Exporter.h"
+#include "PS2ModelExporter.generated.h"
+
+/**
+ * Exports static meshes as .mdl files, the reverse of UInterchangePS2ModelTranslator, from Asset Actions > Export.
+ *
+ * Each LOD is reordered for vertex cache and strip locality and stripified, then written as a strip stream split into
+ * VU1 batches: the runtime uploads the vertices a batch at a time and starts a new strip with each one, so strips never
+ * run across a batch boundary. Batch size comes from the VU1 settings, four qwords per vertex and at most 256 vertices,
+ * the most one VIF UNPACK can hold. Sections with more than one material slot are listed in the .sections.json sidecar
+ * and each starts a batch. Strips are joined with the strip restart mode set for imports, so exported models import
+ * back as the same triangles.
+ */
+UCLASS()
+class PS2LEVELEDITINGTOOLS_API UPS2ModelExporter : public UExporter
+{
+	GENERATED_BODY()
+
+public:
+	UPS2ModelExporter(const FObjectInitializer& ObjectInitializer);
+
+	virtual bool ExportBinary(UObject* Object, const TCHAR* Type, FArchive& Ar, FFeedbackContext* Warn, int32 FileIndex = 0, uint32 PortFlags = 0) override;
+};